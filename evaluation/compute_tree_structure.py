@@ -21,7 +21,15 @@ def compute_tree_structure(elements, fanout, cascading, force_uint64 = False):
     print("overall element count: ", pretty_print(overall_cnt))
     element_size = 8 if elements > pow(2, 32) or force_uint64 else 4
     print("element size: ", element_size)
-    print("overall memory: ", pretty_print(overall_cnt * element_size))
+    # The pointers are stored relative to the begin of their run, so their size
+    # depends on the run length of each level instead of the element count
+    pointer_memory = 0
+    for level in range(2, tree_height + 1):
+        run_length = min(pow(fanout, level), elements)
+        pointer_size = 2 if run_length < pow(2, 16) else 4 if run_length < pow(2, 32) else 8
+        pointer_memory += elements * fanout / cascading * pointer_size
+    print("pointer memory: ", pretty_print(pointer_memory))
+    print("overall memory: ", pretty_print(pure_tree_size * element_size + pointer_memory))
 
 size = 100*1000*1000
 compute_tree_structure(size, 16, 4)
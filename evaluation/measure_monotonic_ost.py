@@ -10,12 +10,15 @@ window_sizes = list(int(pow(2,i/2.0)) for i in range(0, 41))
 window_sizes = list(dict.fromkeys(window_sizes))
 
 # Execute all the benchmark queries
-for percentile in [50, 99]:
-    for window_size in window_sizes:
-        print(f"percentile{percentile},OST,{window_size},", end="")
-        sys.stdout.flush()
-        exec_time = measure_ost("./lineitems_1gb.csv", percentile, window_size)
-        print(exec_time)
-        sys.stdout.flush()
-        if exec_time > 5:
-            break
+for engine, label in [("tree234", "OST"), ("btree", "OST-btree"), ("mergesort", "OST-mergesort")]:
+    for percentile in [50, 99]:
+        for window_size in window_sizes:
+            print(f"percentile{percentile},{label},{window_size},", end="")
+            sys.stdout.flush()
+            exec_time, warm_up = measure_ost("./lineitems_1gb.csv", percentile, window_size, engine=engine, with_warm_up=True)
+            print(exec_time)
+            # The CPU time spent on warming up the morsels, as a separate series
+            print(f"percentile{percentile},{label}-warmup,{window_size},{warm_up}")
+            sys.stdout.flush()
+            if exec_time > 5:
+                break
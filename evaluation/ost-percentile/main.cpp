@@ -1,10 +1,12 @@
 #include "oneapi/tbb.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <charconv>
 #include <chrono>
 #include <cstdint>
-#include <fstream>
+#include <exception>
+#include <iomanip>
 #include <iostream>
 #include <memory>
 #include <optional>
@@ -12,6 +14,12 @@
 #include <string>
 #include <vector>
 
+#include "countedbtree.hpp"
+#include "lineitem.hpp"
+#include "orderedkey.hpp"
+#include "percentile.hpp"
+#include "radixsort.hpp"
+
 extern "C" {
 #include "tree234.h"
 }
@@ -30,77 +38,106 @@ template <typename T> std::optional<T> checkedParse(std::string_view s) {
   return res;
 }
 
-template <typename T> T checkedParse(std::string_view s, const char *error) {
-  std::optional<T> v = checkedParse<T>(s);
-  if (!v)
-    throw error;
-  return *v;
-}
-
 struct Entry {
   uint64_t shipdate;
-  int64_t extendedPrice;
+  double extendedPrice;
 };
 
 std::vector<Entry> loadLineitemsCSV(const std::string &filePath) {
-  std::vector<Entry> data;
-  data.reserve(20000);
-  std::ifstream file(filePath);
-  if (!file.is_open()) {
-    throw "unable to open input file";
-  }
-  std::string line;
-  while (std::getline(file, line)) {
-    // Tokenize the line
-    std::string_view shipdateStr, extendedPriceStr;
-    {
-      int colNr = 0;
-      std::string_view remainingLine = line;
-      while (true) {
-        auto pos = remainingLine.find('\t');
-        ++colNr;
-        const auto match = remainingLine.substr(0, pos);
-        if (colNr == 6) {
-          extendedPriceStr = match;
-        } else if (colNr == 11) {
-          shipdateStr = match;
+  auto table = lineitem::load(
+      filePath, {lineitem::Column::ShipDate, lineitem::Column::ExtendedPrice});
+  std::vector<Entry> data(table.rowCnt);
+  oneapi::tbb::parallel_for(
+      oneapi::tbb::blocked_range<size_t>(0, data.size(), 20000),
+      [&](auto &task) {
+        for (size_t i = task.begin(); i < task.end(); ++i) {
+          data[i] = Entry{static_cast<uint64_t>(table.shipDate[i]),
+                          table.extendedPrice[i]};
         }
-        if (pos == std::string_view::npos)
-          break;
-        remainingLine = remainingLine.substr(pos + 1);
-      }
-      if (colNr != 16) {
-        throw "unexpected number of columns in input file";
-      }
-    }
-    // Parse shipdate
-    uint64_t shipdate;
-    {
-      const char *errStr = "invalid date";
-      auto firstDash = shipdateStr.find('-');
-      if (firstDash == std::string_view::npos)
-        throw errStr;
-      auto secondDash = shipdateStr.find('-', firstDash + 1);
-      if (secondDash == std::string_view::npos)
-        throw errStr;
-      std::string_view yearStr = shipdateStr.substr(0, firstDash);
-      std::string_view monthStr =
-          shipdateStr.substr(firstDash + 1, secondDash - firstDash - 1);
-      std::string_view dayStr = shipdateStr.substr(secondDash + 1);
-      int year = checkedParse<int>(yearStr, errStr);
-      int month = checkedParse<int>(monthStr, errStr);
-      int day = checkedParse<int>(dayStr, errStr);
-      // Bitpack year, month and day into a single integer
-      shipdate = (year * 16 + month) * 32 + day;
+      });
+  return data;
+}
+
+/// The order-statistics tree which maintains the frame
+enum class Engine {
+  /// Simon Tatham's pointer-based 2-3-4 tree
+  Tree234,
+  /// The counted B+-tree of the standalone implementation
+  CountedBTree,
+  /// `mergesortPercentile` of the standalone implementation, which builds a
+  /// merge sort tree over all rows instead of maintaining the frame
+  MergeSortTree,
+};
+
+std::optional<Engine> parseEngine(std::string_view s) {
+  if (s == "tree234")
+    return Engine::Tree234;
+  if (s == "btree")
+    return Engine::CountedBTree;
+  if (s == "mergesort")
+    return Engine::MergeSortTree;
+  return {};
+}
+
+/// A row in the counted B+-tree. The row number makes duplicate prices unique.
+struct PriceKey {
+  double extendedPrice;
+  uint64_t row;
+};
+
+struct PriceKeyLess {
+  bool operator()(const PriceKey &a, const PriceKey &b) const {
+    if (a.extendedPrice != b.extendedPrice) {
+      return a.extendedPrice < b.extendedPrice;
     }
-    // Parse extendedPrice
-    auto extendedPriceFloat =
-        checkedParse<double>(extendedPriceStr, "invalid price");
-    auto extendedPrice = static_cast<int64_t>(extendedPriceFloat * 100);
-    // Construct the result
-    data.push_back(Entry{shipdate, extendedPrice});
+    return a.row < b.row;
   }
-  return data;
+};
+
+using PriceTree = CountedBTree<PriceKey, 64, 32, PriceKeyLess>;
+
+/// Smallest frame for which a morsel bulk-loads its `PriceTree` instead of
+/// inserting the rows. Below, the fixed costs of the radix sort dominate.
+constexpr uint64_t minBulkWarmUp = 4096;
+
+/// Shape of the merge sort tree used by `Engine::MergeSortTree`
+constexpr int64_t mergesortFanout = 8;
+constexpr int64_t mergesortCascading = 8;
+
+/// Time the morsels spent in total and on building the frame of their first row
+struct MorselStats {
+  std::atomic<int64_t> warmUpNs = 0;
+  std::atomic<int64_t> totalNs = 0;
+};
+
+/// Measures the warm-up and the processing of one morsel
+class MorselTimer {
+  MorselStats &stats;
+  std::chrono::steady_clock::time_point start, warmedUp;
+
+public:
+  explicit MorselTimer(MorselStats &stats)
+      : stats(stats), start(std::chrono::steady_clock::now()) {}
+  void warmUpDone() { warmedUp = std::chrono::steady_clock::now(); }
+  ~MorselTimer() {
+    auto ns = [](auto d) {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+    };
+    stats.warmUpNs += ns(warmedUp - start);
+    stats.totalNs += ns(std::chrono::steady_clock::now() - start);
+  }
+};
+
+/// Morsel size which keeps the warm-up of each morsel, i.e. inserting the
+/// `windowSize` rows before it, to at most a quarter of its inserts. The
+/// morsels are still small enough to give each thread a few of them.
+uint64_t adaptiveGrainSize(uint64_t dataSize, uint64_t windowSize) {
+  // The fixed grain size the benchmarks used before
+  constexpr uint64_t minGrainSize = 20000;
+  uint64_t threadCnt = oneapi::tbb::global_control::active_value(
+      oneapi::tbb::global_control::max_allowed_parallelism);
+  uint64_t balanced = (dataSize + 4 * threadCnt - 1) / (4 * threadCnt);
+  return std::max(minGrainSize, std::min(4 * windowSize, balanced));
 }
 
 struct Tree234Deleter {
@@ -116,13 +153,13 @@ Evaluate
         ROWS BETWEEN <windowSize> - 1 preceding AND current row)
     FROM <inputData>
 */
-std::unique_ptr<uint64_t[]> evaluateQuery(std::span<const Entry> originalData,
-                                          uint64_t windowSize,
-                                          double percentile,
-                                          uint64_t grainSize) {
+std::unique_ptr<double[]> evaluateQuery(std::span<const Entry> originalData,
+                                        uint64_t windowSize, double percentile,
+                                        uint64_t grainSize, Engine engine,
+                                        MorselStats &stats) {
   assert(windowSize > 0);
   assert(percentile >= 0);
-  assert(percentile <= 0);
+  assert(percentile <= 1);
   // Copy the data, as we need to sort it but must not modify it in-place
   // Use `unique_ptr` instead of `std::vector` to avoid unnecessary
   // initialization
@@ -130,24 +167,30 @@ std::unique_ptr<uint64_t[]> evaluateQuery(std::span<const Entry> originalData,
   std::unique_ptr<Entry[]> data =
       std::make_unique_for_overwrite<Entry[]>(dataSize);
 
-  oneapi::tbb::parallel_for(
-      oneapi::tbb::blocked_range<size_t>(0, dataSize, 20000), [&](auto &task) {
-        for (size_t i = task.begin(); i < task.end(); ++i) {
-          data[i] = originalData[i];
-        }
-      });
-
-  // Sort according to window frame, i.e. by `l_shipdate`
-  auto windowComparator = [](const Entry &a, const Entry &b) {
-    return a.shipdate < b.shipdate;
-  };
-  oneapi::tbb::parallel_sort(data.get(), data.get() + dataSize,
-                             windowComparator);
+  // Sort according to window frame, i.e. by `l_shipdate`. Dates only span a
+  // few thousand days, so a counting sort copies the rows directly into
+  // their sorted positions. Other keys fall back to a comparison sort.
+  auto shipdate = [](const Entry &e) { return e.shipdate; };
+  if (!radix::countingSort(originalData.data(), data.get(), dataSize,
+                           shipdate)) {
+    oneapi::tbb::parallel_for(
+        oneapi::tbb::blocked_range<size_t>(0, dataSize, 20000),
+        [&](auto &task) {
+          for (size_t i = task.begin(); i < task.end(); ++i) {
+            data[i] = originalData[i];
+          }
+        });
+    auto windowComparator = [](const Entry &a, const Entry &b) {
+      return a.shipdate < b.shipdate;
+    };
+    oneapi::tbb::parallel_sort(data.get(), data.get() + dataSize,
+                               windowComparator);
+  }
 
   // Use `unique_ptr` instead of `std::vector` to avoid unnecessary
   // initialization
-  std::unique_ptr<uint64_t[]> medians =
-      std::make_unique_for_overwrite<uint64_t[]>(dataSize);
+  std::unique_ptr<double[]> medians =
+      std::make_unique_for_overwrite<double[]>(dataSize);
 
   // Compute the median
   auto medianComparator = [](void *a, void *b) -> int {
@@ -163,16 +206,100 @@ std::unique_ptr<uint64_t[]> evaluateQuery(std::span<const Entry> originalData,
     }
     return 0;
   };
+  // Position of the percentile within the frame of row `i`, which holds the
+  // rows `(i - windowSize, i]`
+  auto percentilePos = [&](uint64_t i) {
+    return percentileIndex(std::min(i + 1, windowSize), percentile);
+  };
+  if (engine == Engine::MergeSortTree) {
+    // The merge sort tree parallelizes its build and its queries itself, so
+    // the grain size does not apply
+    std::vector<double> prices(dataSize);
+    oneapi::tbb::parallel_for(
+        oneapi::tbb::blocked_range<size_t>(0, dataSize, 20000),
+        [&](auto &task) {
+          for (size_t i = task.begin(); i < task.end(); ++i) {
+            prices[i] = data[i].extendedPrice;
+          }
+        });
+    auto lowerBound = [windowSize](int64_t i, int64_t) {
+      return std::max<int64_t>(0, i + 1 - static_cast<int64_t>(windowSize));
+    };
+    auto results = mergesortPercentile<mergesortFanout, mergesortCascading>(
+        prices, lowerBound, framebounds::untilCurrentRow, percentile);
+    oneapi::tbb::parallel_for(
+        oneapi::tbb::blocked_range<size_t>(0, dataSize, 20000),
+        [&](auto &task) {
+          for (size_t i = task.begin(); i < task.end(); ++i) {
+            medians[i] = results[i];
+          }
+        });
+    return medians;
+  }
+  if (engine == Engine::CountedBTree) {
+    oneapi::tbb::parallel_for(
+        oneapi::tbb::blocked_range<size_t>(0, dataSize, grainSize),
+        [&](auto &task) {
+          MorselTimer timer(stats);
+          PriceTree tree;
+          auto key = [&](uint64_t i) {
+            return PriceKey{data[i].extendedPrice, i};
+          };
+          // Construct start state for frame. For large frames, radix sorting
+          // the rows and building the tree bottom-up is about twice as fast
+          // as inserting them one by one.
+          uint64_t frameBegin = std::max<int64_t>(
+              0, static_cast<int64_t>(task.begin()) -
+                     static_cast<int64_t>(windowSize));
+          if (task.begin() - frameBegin < minBulkWarmUp) {
+            for (uint64_t i = frameBegin; i < task.begin(); ++i) {
+              tree.insert(key(i));
+            }
+          } else {
+            // The sort is stable and the rows are ascending, so equal prices
+            // end up ordered by row as in `PriceKeyLess`. TBB already runs
+            // the morsels in parallel, so each one sorts on its own thread.
+            std::vector<uint64_t> prices, rows;
+            prices.reserve(task.begin() - frameBegin);
+            rows.reserve(task.begin() - frameBegin);
+            for (uint64_t i = frameBegin; i < task.begin(); ++i) {
+              prices.push_back(
+                  radix::toKey(orderedkey::encode(data[i].extendedPrice)));
+              rows.push_back(i);
+            }
+            radix::sortPairs(prices, rows, radix::singleChunk);
+            std::vector<PriceKey> frame;
+            frame.reserve(rows.size());
+            for (auto row : rows) {
+              frame.push_back(key(row));
+            }
+            tree.assign(frame.begin(), frame.end());
+          }
+          timer.warmUpDone();
+          // Process tuples inside frame
+          for (uint64_t i = task.begin(); i < task.end(); ++i) {
+            tree.insert(key(i));
+            if (i >= windowSize) {
+              tree.erase(key(i - windowSize));
+            }
+            medians[i] = tree.select(percentilePos(i)).extendedPrice;
+          }
+        });
+    return medians;
+  }
   bool parallelized = false;
   oneapi::tbb::parallel_for(
       oneapi::tbb::blocked_range<size_t>(0, dataSize, grainSize),
       [&](auto &task) {
+        MorselTimer timer(stats);
         Tree234Ptr tree{newtree234(medianComparator)};
-        // Construct start state for frame
+        // Construct start state for frame. `tree234` can only be built from
+        // sorted input if it has no comparator, so we insert row by row.
         for (uint64_t i = std::max<int64_t>(0, task.begin() - windowSize);
              i < task.begin(); ++i) {
           add234(tree.get(), &data[i]);
         }
+        timer.warmUpDone();
         // Process tuples inside frame
         for (uint64_t i = task.begin(); i < task.end(); ++i) {
           add234(tree.get(), &data[i]);
@@ -180,10 +307,8 @@ std::unique_ptr<uint64_t[]> evaluateQuery(std::span<const Entry> originalData,
           if (i >= windowSize) {
             del234(tree.get(), &data[i - windowSize]);
           }
-          auto currentSize = std::min(i, windowSize);
-          auto percentilePos = static_cast<size_t>(currentSize * percentile);
           auto *percentileNode =
-              reinterpret_cast<Entry *>(index234(tree.get(), percentilePos));
+              reinterpret_cast<Entry *>(index234(tree.get(), percentilePos(i)));
           medians[i] = percentileNode->extendedPrice;
         }
       });
@@ -193,13 +318,17 @@ std::unique_ptr<uint64_t[]> evaluateQuery(std::span<const Entry> originalData,
 
 int main(int argc, const char **argv) {
   try {
-    if (argc != 5)
-      throw "not enough arguments";
+    if (argc < 5 || argc > 7)
+      throw "usage: ost_percentile <file> <window size> <grain size|auto> "
+            "<percentile> [tree234|btree|mergesort] [threads]";
     std::string filePath = argv[1];
     auto windowSize = checkedParse<uint32_t>(argv[2]);
     if (!windowSize)
       throw "invalid window size";
-    auto grainSize = checkedParse<uint32_t>(argv[3]);
+    // `auto` adapts the grain size to the window size
+    bool adaptiveGrain = std::string_view(argv[3]) == "auto";
+    auto grainSize = adaptiveGrain ? std::optional<uint64_t>{0}
+                                   : checkedParse<uint64_t>(argv[3]);
     if (!grainSize)
       throw "invalid grain size";
     auto percentileInt = checkedParse<uint32_t>(argv[4]);
@@ -208,12 +337,34 @@ int main(int argc, const char **argv) {
     if (percentileInt > 100)
       throw "invalid percentile";
     auto percentile = static_cast<double>(*percentileInt) / 100;
+    auto engine = argc >= 6 ? parseEngine(argv[5]) : Engine::Tree234;
+    if (!engine)
+      throw "invalid engine";
+    // 0 uses all cores
+    auto threadCnt =
+        argc >= 7 ? checkedParse<uint32_t>(argv[6]) : std::optional<uint32_t>{0};
+    if (!threadCnt)
+      throw "invalid thread count";
+    // Limits both TBB and the threads of the standalone implementation
+    std::optional<oneapi::tbb::global_control> threadLimit;
+    if (*threadCnt) {
+      threadLimit.emplace(oneapi::tbb::global_control::max_allowed_parallelism,
+                          *threadCnt);
+      parallel::setThreadCount(*threadCnt);
+    }
 
     // Load
+    auto loadStart = std::chrono::steady_clock::now();
     std::vector<Entry> data = loadLineitemsCSV(filePath);
-    std::cerr << "loaded\n";
+    // Not in milliseconds, so that scripts parsing the times ignore it
+    std::chrono::duration<double> loadTime =
+        std::chrono::steady_clock::now() - loadStart;
+    std::cerr << "loaded " << data.size() << " rows in " << loadTime.count()
+              << " s\n";
 
-    if (!*grainSize)
+    if (adaptiveGrain)
+      grainSize = adaptiveGrainSize(data.size(), *windowSize);
+    else if (!*grainSize)
       grainSize = data.size();
 
     std::chrono::duration<double, std::milli> overallTime{0};
@@ -221,7 +372,9 @@ int main(int argc, const char **argv) {
       auto start = std::chrono::steady_clock::now();
 
       // Evaluate the query
-      auto medians = evaluateQuery(data, *windowSize, percentile, *grainSize);
+      MorselStats stats;
+      auto medians = evaluateQuery(data, *windowSize, percentile, *grainSize,
+                                   *engine, stats);
       // Make sure the computations are not optimized out
       escape(medians.get());
       clobber();
@@ -229,6 +382,13 @@ int main(int argc, const char **argv) {
       auto end = std::chrono::steady_clock::now();
       auto elapsedMs = std::chrono::duration<double, std::milli>(end - start);
       std::cerr << elapsedMs.count() << "ms\n";
+      // Reported apart from the elapsed time, and in a different format, so
+      // that scripts parsing the times do not pick it up
+      auto warmUpShare = stats.totalNs ? 100.0 * stats.warmUpNs / stats.totalNs : 0;
+      std::cerr << "warm-up: " << std::fixed << std::setprecision(1)
+                << stats.warmUpNs / 1e6 << " cpu-ms, " << warmUpShare
+                << "% of morsel time\n"
+                << std::defaultfloat << std::setprecision(6);
       overallTime += elapsedMs;
       if (overallTime.count() > 10*1000) break;
 
@@ -243,5 +403,8 @@ int main(int argc, const char **argv) {
   } catch (const char *e) {
     std::cerr << e << '\n';
     return 1;
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return 1;
   }
 }
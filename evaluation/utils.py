@@ -1,3 +1,4 @@
+import os
 import time
 import sys
 import subprocess
@@ -51,9 +52,22 @@ def measure_times(body, timeout=120):
     return median(times)
 
 
-def measure_ost(file_path, percentile, window_size, morsel_size = 20000):
+# The binary columnar copy of a lineitem file, see `lineitem::save`. It is
+# (re)created when missing or older than the file, so that the benchmark
+# processes copy their inputs instead of parsing the text again
+def lineitem_cache(file_path):
+    cache_path = str(file_path) + ".columns"
+    if not os.path.exists(cache_path) or os.path.getmtime(cache_path) < os.path.getmtime(file_path):
+        subprocess.run(["./ost-percentile/build/lineitem_cache", str(file_path), cache_path],
+                       check=True, stdout=subprocess.DEVNULL)
+    return cache_path
+
+
+# With `with_warm_up`, also returns the median CPU time the morsels spent on
+# building the frame of their first row
+def measure_ost(file_path, percentile, window_size, morsel_size = "auto", engine = "tree234", threads = 0, with_warm_up = False):
     assert percentile <= 100
-    command = ["./ost-percentile/build/ost_percentile", str(file_path), str(window_size), str(morsel_size), str(percentile)]
+    command = ["./ost-percentile/build/ost_percentile", lineitem_cache(file_path), str(window_size), str(morsel_size), str(percentile), engine, str(threads)]
     process = subprocess.Popen(command,
                          stdout=subprocess.PIPE, 
                          stderr=subprocess.STDOUT)
@@ -61,6 +75,10 @@ def measure_ost(file_path, percentile, window_size, morsel_size = 20000):
     # print(stdout.decode('utf-8'))
     p = re.compile('(\d+\.\d+)ms')
     times = [float(t)/1000 for t in p.findall(stdout.decode('utf-8'))]
+    if with_warm_up:
+        p = re.compile('warm-up: (\d+\.\d+) cpu-ms')
+        warm_ups = [float(t)/1000 for t in p.findall(stdout.decode('utf-8'))]
+        return median(times), median(warm_ups)
     return median(times)
 
 
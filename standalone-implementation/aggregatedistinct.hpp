@@ -1,35 +1,164 @@
 #include <vector>
 #include <array>
-#include <unordered_map>
 #include <unordered_set>
 #include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include <tuple>
+#include <utility>
 #include "mergesorttree.hpp"
+#include "flathashmap.hpp"
+#include "radixsort.hpp"
 
 namespace aggregates {
+  /// An aggregate provides a `StateType` with `init`, `mergeValue` and `merge`, and
+  /// turns its state into a `ResultType` using `finalize`. Invertible aggregates
+  /// additionally provide `removeValue`.
   template<typename T>
   struct count {
     using StateType = int64_t;
+    using ResultType = int64_t;
     static StateType init() { return 0; }
     static StateType mergeValue(StateType a, T /*x*/) { return a+1; }
     static StateType removeValue(StateType a, T /*x*/) { return a-1; }
     static StateType merge(StateType a, StateType b) { return a+b; }
+    static ResultType finalize(StateType a) { return a; }
   };
 
   template<typename T>
   struct sum {
     using StateType = T;
+    using ResultType = T;
     static StateType init() { return 0; }
     static StateType mergeValue(StateType a, T b) { return a+b; }
     static StateType removeValue(StateType a, T b) { return a-b; }
     static StateType merge(StateType a, StateType b) { return a+b; }
+    static ResultType finalize(StateType a) { return a; }
   };
+
+  /// The minimum. Empty frames yield `std::numeric_limits<T>::max()`
+  template<typename T>
+  struct min {
+    using StateType = T;
+    using ResultType = T;
+    static StateType init() { return std::numeric_limits<T>::max(); }
+    static StateType mergeValue(StateType a, T b) { return std::min(a, b); }
+    static StateType merge(StateType a, StateType b) { return std::min(a, b); }
+    static ResultType finalize(StateType a) { return a; }
+  };
+
+  /// The maximum. Empty frames yield `std::numeric_limits<T>::lowest()`
+  template<typename T>
+  struct max {
+    using StateType = T;
+    using ResultType = T;
+    static StateType init() { return std::numeric_limits<T>::lowest(); }
+    static StateType mergeValue(StateType a, T b) { return std::max(a, b); }
+    static StateType merge(StateType a, StateType b) { return std::max(a, b); }
+    static ResultType finalize(StateType a) { return a; }
+  };
+
+  /// The arithmetic mean. Empty frames yield NaN
+  template<typename T>
+  struct avg {
+    struct StateType {
+      T sum;
+      int64_t count;
+    };
+    using ResultType = double;
+    static StateType init() { return {0, 0}; }
+    static StateType mergeValue(StateType a, T b) { return {a.sum + b, a.count + 1}; }
+    static StateType removeValue(StateType a, T b) { return {a.sum - b, a.count - 1}; }
+    static StateType merge(StateType a, StateType b) { return {a.sum + b.sum, a.count + b.count}; }
+    static ResultType finalize(StateType a) {
+      return a.count ? static_cast<double>(a.sum) / a.count : std::numeric_limits<double>::quiet_NaN();
+    }
+  };
+
+  /// The sample variance, i.e. SQL's `VARIANCE`. Frames with less than two values yield NaN.
+  ///
+  /// Values are added using Welford's algorithm and states are merged using the
+  /// pairwise update by Chan et al. Both avoid the cancellation of the textbook
+  /// formula based on the sum of squares. Since the states can't be inverted
+  /// reliably, there is no `removeValue`.
+  template<typename T>
+  struct variance {
+    struct StateType {
+      int64_t count;
+      double mean;
+      /// Sum of squared differences from the mean
+      double m2;
+    };
+    using ResultType = double;
+    static StateType init() { return {0, 0, 0}; }
+    static StateType mergeValue(StateType a, T b) {
+      auto count = a.count + 1;
+      auto delta = b - a.mean;
+      auto mean = a.mean + delta / count;
+      return {count, mean, a.m2 + delta * (b - mean)};
+    }
+    static StateType merge(StateType a, StateType b) {
+      if (!a.count) return b;
+      if (!b.count) return a;
+      auto count = a.count + b.count;
+      auto delta = b.mean - a.mean;
+      auto mean = a.mean + delta * b.count / count;
+      auto m2 = a.m2 + b.m2 + delta * delta * a.count * b.count / count;
+      return {count, mean, m2};
+    }
+    static ResultType finalize(StateType a) {
+      return a.count > 1 ? a.m2 / (a.count - 1) : std::numeric_limits<double>::quiet_NaN();
+    }
+  };
+
+  /// The sample standard deviation, i.e. SQL's `STDDEV`
+  template<typename T>
+  struct stddev : variance<T> {
+    using typename variance<T>::StateType;
+    static double finalize(StateType a) { return std::sqrt(variance<T>::finalize(a)); }
+  };
+
+  /// Computes several aggregates at once. The state and result are tuples
+  /// with one entry per aggregate.
+  template<typename... Aggs>
+  struct combined {
+    using StateType = std::tuple<typename Aggs::StateType...>;
+    using ResultType = std::tuple<typename Aggs::ResultType...>;
+    static StateType init() { return {Aggs::init()...}; }
+    template<typename T>
+    static StateType mergeValue(const StateType& a, T b) { return mergeValue(a, b, std::index_sequence_for<Aggs...>{}); }
+    static StateType merge(const StateType& a, const StateType& b) { return merge(a, b, std::index_sequence_for<Aggs...>{}); }
+    static ResultType finalize(const StateType& a) { return finalize(a, std::index_sequence_for<Aggs...>{}); }
+
+    private:
+    template<typename T, size_t... I>
+    static StateType mergeValue(const StateType& a, T b, std::index_sequence<I...>) {
+      return {Aggs::mergeValue(std::get<I>(a), b)...};
+    }
+    template<size_t... I>
+    static StateType merge(const StateType& a, const StateType& b, std::index_sequence<I...>) {
+      return {Aggs::merge(std::get<I>(a), std::get<I>(b))...};
+    }
+    template<size_t... I>
+    static ResultType finalize(const StateType& a, std::index_sequence<I...>) {
+      return {Aggs::finalize(std::get<I>(a))...};
+    }
+  };
+
+  /// Does `Agg` support removing values from its state?
+  template<typename Agg, typename = void>
+  constexpr bool isInvertible = false;
+  template<typename Agg>
+  constexpr bool isInvertible<Agg, std::void_t<decltype(Agg::removeValue(Agg::init(), 0))>> = true;
 }
 
 
 template<typename Agg, typename T1, typename T2>
-std::vector<int64_t> naiveAggregateDistinct(const std::vector<int64_t>& inputData, T1 lowerBound, T2 upperBound) {
+std::vector<typename Agg::ResultType> naiveAggregateDistinct(const std::vector<int64_t>& inputData, T1 lowerBound, T2 upperBound) {
   using namespace std;
-  vector<int64_t> result;
+  vector<typename Agg::ResultType> result;
   result.reserve(inputData.size());
   for (size_t i = 0; i < inputData.size(); ++i) {
     auto lower = lowerBound(i, inputData.size());
@@ -41,7 +170,7 @@ std::vector<int64_t> naiveAggregateDistinct(const std::vector<int64_t>& inputDat
         aggState = Agg::mergeValue(aggState, inputData[j]);
       }
     }
-    result.push_back(aggState);
+    result.push_back(Agg::finalize(aggState));
   }
   return result;
 }
@@ -64,78 +193,140 @@ std::vector<int64_t> naiveCountDistinct(const std::vector<int64_t>& inputData, T
 }
 
 
+/// Moves the frame `[prevLower, prevUpper)` to `[lower, upper)`, calling
+/// `removeRow(j)` for all rows leaving it and `addRow(j)` for all rows entering it
+template<typename A, typename R>
+void moveFrame(int64_t& prevLower, int64_t& prevUpper, int64_t lower, int64_t upper, A addRow, R removeRow) {
+  using namespace std;
+  // Normalize empty frames, so that we never touch a row twice
+  upper = max(lower, upper);
+  // Remove
+  // below new window
+  if (prevLower < lower) {
+    for (int64_t j = prevLower; j < min(prevUpper, lower); j++) {
+      removeRow(j);
+    }
+  }
+  // above new window
+  if (prevUpper > upper) {
+    for (int64_t j = max(upper, prevLower); j < prevUpper; j++) {
+      removeRow(j);
+    }
+  }
+  // Add
+  // below old window
+  if (prevLower > lower) {
+    for (int64_t j = lower; j < min(prevLower, upper); ++j) {
+      addRow(j);
+    }
+  }
+  // above old window
+  if (prevUpper < upper) {
+    for (int64_t j = max(lower, prevUpper); j < upper; ++j) {
+      addRow(j);
+    }
+  }
+  prevLower = lower;
+  prevUpper = upper;
+}
+
+
+/// Sliding-window aggregation for aggregates without `removeValue`.
+///
+/// The distinct values are mapped to dense codes, and a segment tree over the
+/// codes holds the aggregate of all values currently contained in the frame.
+/// A value entering or leaving the frame updates one leaf and its path to
+/// the root, i.e. each row costs O(log d) for d distinct values.
 template<typename Agg, typename T1, typename T2>
-std::vector<int64_t> incrementalAggregateDistinct(const std::vector<int64_t>& inputData, T1 lowerBound, T2 upperBound) {
+std::vector<typename Agg::ResultType> segmentTreeAggregateDistinct(const std::vector<int64_t>& inputData, T1 lowerBound, T2 upperBound) {
   using namespace std;
-  vector<int64_t> result;
-  result.reserve(inputData.size());
-  unordered_map<int64_t, int64_t> distinctValues;
+  int64_t n = inputData.size();
+  vector<typename Agg::ResultType> result;
+  result.reserve(n);
+  if (!n) return result;
+  // Assign dense codes
+  vector<int64_t> distinctValues(inputData);
+  sort(distinctValues.begin(), distinctValues.end());
+  distinctValues.erase(unique(distinctValues.begin(), distinctValues.end()), distinctValues.end());
+  vector<int64_t> codes(n);
+  for (int64_t i = 0; i < n; ++i) {
+    codes[i] = lower_bound(distinctValues.begin(), distinctValues.end(), inputData[i]) - distinctValues.begin();
+  }
+  // The segment tree. Node `i` has the children `2i` and `2i+1`, the leaves start at `leafCnt`
+  int64_t leafCnt = 1;
+  while (leafCnt < static_cast<int64_t>(distinctValues.size())) leafCnt *= 2;
+  vector<typename Agg::StateType> segmentTree(2 * leafCnt, Agg::init());
+  vector<int64_t> occurrences(distinctValues.size());
+  auto updateLeaf = [&](int64_t code, typename Agg::StateType state) {
+    int64_t node = leafCnt + code;
+    segmentTree[node] = state;
+    for (node /= 2; node; node /= 2) {
+      segmentTree[node] = Agg::merge(segmentTree[2 * node], segmentTree[2 * node + 1]);
+    }
+  };
+  auto addRow = [&](int64_t j) {
+    auto code = codes[j];
+    if (occurrences[code]++ == 0) updateLeaf(code, Agg::mergeValue(Agg::init(), inputData[j]));
+  };
+  auto removeRow = [&](int64_t j) {
+    auto code = codes[j];
+    if (--occurrences[code] == 0) updateLeaf(code, Agg::init());
+  };
   int64_t prevLower = 0;
   int64_t prevUpper = 0;
-  auto aggState = Agg::init();
-  int64_t nonZero = 0;
-  for (size_t i = 0; i < inputData.size(); ++i) {
-    // Reset hashtable (using theta = 0.25; from Richard Wesleys paper)
-    if (distinctValues.size() > nonZero*4) {
-      prevLower = 0;
-      prevUpper = 0;
-      nonZero = 0;
-      aggState = Agg::init();
-      distinctValues = {};
-    }
+  for (int64_t i = 0; i < n; ++i) {
+    moveFrame(prevLower, prevUpper, lowerBound(i, n), upperBound(i, n), addRow, removeRow);
+    result.push_back(Agg::finalize(segmentTree[1]));
+  }
+  return result;
+}
 
-    int64_t lower = lowerBound(i, inputData.size());
-    int64_t upper = upperBound(i, inputData.size());
-    //cout << "lower " << lower << endl;
-    //cout << "upper " << upper << endl;
-    // Remove
-    // below new window
-    if (prevLower < lower) {
-      for (int64_t j = prevLower; j < min(prevUpper, lower); j++) {
-        //cout << " - " << j << endl;
-        if (--distinctValues[inputData[j]] == 0) {
-          aggState = Agg::removeValue(aggState, inputData[j]);
-          --nonZero;
-        }
-      }
-    }
-    // above new window
-    if (prevUpper > upper) {
-      for (int64_t j = max(upper, prevLower); j < prevUpper; j++) {
-        //cout << " - " << j << endl;
-        if (--distinctValues[inputData[j]] == 0) {
-          aggState = Agg::removeValue(aggState, inputData[j]);
-          --nonZero;
-        }
+
+template<typename Agg, typename T1, typename T2>
+std::vector<typename Agg::ResultType> incrementalAggregateDistinct(const std::vector<int64_t>& inputData, T1 lowerBound, T2 upperBound) {
+  using namespace std;
+  if constexpr (!aggregates::isInvertible<Agg>) {
+    return segmentTreeAggregateDistinct<Agg>(inputData, lowerBound, upperBound);
+  } else {
+    vector<typename Agg::ResultType> result;
+    result.reserve(inputData.size());
+    FlatHashMap<int64_t, int64_t> distinctValues;
+    int64_t prevLower = 0;
+    int64_t prevUpper = 0;
+    auto aggState = Agg::init();
+    int64_t nonZero = 0;
+    auto addRow = [&](int64_t j) {
+      auto v = inputData[j];
+      if (distinctValues[v]++ == 0) {
+        aggState = Agg::mergeValue(aggState, v);
+        ++nonZero;
       }
-    }
-    // Add
-    // below old window
-    if (prevLower > lower) {
-      for (int64_t j = lower; j < min(prevLower, upper); ++j) {
-        //cout << " + " << j << endl;
-        if (distinctValues[inputData[j]]++ == 0) {
-          aggState = Agg::mergeValue(aggState, inputData[j]);
-          ++nonZero;
-        }
+    };
+    // Values whose count drops to zero stay in the hash table until the next
+    // reset. Erasing them eagerly was measurably slower for frames with many
+    // distinct values.
+    auto removeRow = [&](int64_t j) {
+      auto v = inputData[j];
+      if (--*distinctValues.find(v) == 0) {
+        aggState = Agg::removeValue(aggState, v);
+        --nonZero;
       }
-    }
-    // above old window
-    if (prevUpper < upper) {
-      for (int64_t j = max(lower, prevUpper); j < upper; ++j) {
-        //cout << " + " << j << endl;
-        if (distinctValues[inputData[j]]++ == 0) {
-          aggState = Agg::mergeValue(aggState, inputData[j]);
-          ++nonZero;
-        }
+    };
+    for (size_t i = 0; i < inputData.size(); ++i) {
+      // Reset hashtable (using theta = 0.25; from Richard Wesleys paper)
+      if (distinctValues.size() > nonZero*4) {
+        prevLower = 0;
+        prevUpper = 0;
+        nonZero = 0;
+        aggState = Agg::init();
+        distinctValues.clear();
       }
+      moveFrame(prevLower, prevUpper, lowerBound(i, inputData.size()), upperBound(i, inputData.size()), addRow, removeRow);
+      // Comute value
+      result.push_back(Agg::finalize(aggState));
     }
-    // Comute value
-    result.push_back(aggState);
-    prevLower = lower;
-    prevUpper = upper;
+    return result;
   }
-  return result;
 }
 
 
@@ -145,11 +336,11 @@ std::vector<int64_t> incrementalCountDistinct(const std::vector<int64_t>& inputD
 }
 
 
-std::vector<int64_t> computePrevOffsets(const std::vector<int64_t>& inputData) {
+inline std::vector<int64_t> computePrevOffsetsHash(const std::vector<int64_t>& inputData) {
   using namespace std;
   vector<int64_t> result;
   result.reserve(inputData.size());
-  unordered_map<int64_t, int64_t> prevIdcs;
+  FlatHashMap<int64_t, int64_t> prevIdcs;
   for (size_t i = 0; i < inputData.size(); ++i) {
     auto& prevPos = prevIdcs[inputData[i]];
     result.push_back(prevPos);
@@ -159,16 +350,125 @@ std::vector<int64_t> computePrevOffsets(const std::vector<int64_t>& inputData) {
 }
 
 
-template<int64_t fanout, int64_t cascading, typename T1, typename T2>
+template<typename PosT>
+std::vector<int64_t> computePrevOffsetsSort(const std::vector<int64_t>& inputData) {
+  using namespace std;
+  int64_t n = inputData.size();
+  // We only need to group equal values, so any bijective key works. Subtracting
+  // the minimum clears the upper bytes for small value ranges, and the radix
+  // sort skips those bytes.
+  auto minValue = n ? *min_element(inputData.begin(), inputData.end()) : 0;
+  vector<uint64_t> keys(n);
+  vector<PosT> positions(n);
+  parallel::forEachChunk(n, radix::minChunkSize, [&](int64_t, int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; ++i) {
+      keys[i] = static_cast<uint64_t>(inputData[i]) - static_cast<uint64_t>(minValue);
+      positions[i] = i;
+    }
+  });
+  // The sort is stable, so equal values remain ordered by their position
+  radix::sortPairs(keys, positions);
+  // Each value's previous occurrence is its left neighbor in the sorted array
+  vector<int64_t> result(n);
+  parallel::forEachChunk(n, radix::minChunkSize, [&](int64_t, int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; ++i) {
+      result[positions[i]] = (i && keys[i] == keys[i-1]) ? positions[i-1] + 1 : 0;
+    }
+  });
+  return result;
+}
+
+
+inline std::vector<int64_t> computePrevOffsetsSort(const std::vector<int64_t>& inputData) {
+  if (inputData.size() <= std::numeric_limits<uint32_t>::max()) {
+    return computePrevOffsetsSort<uint32_t>(inputData);
+  } else {
+    return computePrevOffsetsSort<uint64_t>(inputData);
+  }
+}
+
+
+/// Decides between `computePrevOffsetsHash` and `computePrevOffsetsSort`.
+///
+/// We estimate the number of distinct values from a sample. As long as the
+/// resulting hash table fits into the cache, the single hash pass wins. The
+/// larger the table gets, the more probes miss the cache, and at some point
+/// the radix sort, which streams over the data a few times but uses all
+/// cores, becomes cheaper.
+inline bool preferSortForPrevOffsets(const std::vector<int64_t>& inputData) {
+  using namespace std;
+  // Measured on a single core; in nanoseconds per row
+  constexpr double hashCostInCache = 10;
+  constexpr double hashCostPerCacheDoubling = 15;
+  constexpr double sortCostPerPass = 20;
+  constexpr double cacheSize = 2 * 1024 * 1024;
+  constexpr int64_t hashEntrySize = 2 * sizeof(int64_t) + 1;
+  constexpr int64_t sampleSize = 16 * 1024;
+
+  int64_t n = inputData.size();
+  if (n < 16 * sampleSize) return false;
+  FlatHashMap<int64_t, int64_t> sampleValues(sampleSize);
+  auto sampleMin = inputData[0], sampleMax = inputData[0];
+  for (int64_t i = 0; i < sampleSize; ++i) {
+    auto v = inputData[i * n / sampleSize];
+    sampleValues[v] = 1;
+    sampleMin = min(sampleMin, v);
+    sampleMax = max(sampleMax, v);
+  }
+  // Assuming uniformly distributed values, a sample of size `s` drawn from `d`
+  // distinct values is expected to contain `d * (1 - exp(-s/d))` distinct
+  // values. Solve for `d` by bisection.
+  double sampleDistinct = sampleValues.size();
+  auto expectedSampleDistinct = [&](double d) { return d * -expm1(-sampleSize / d); };
+  double estimatedDistinct = n;
+  if (expectedSampleDistinct(n) > sampleDistinct) {
+    double low = sampleDistinct, high = n;
+    for (int i = 0; i < 64; ++i) {
+      double mid = sqrt(low * high);
+      (expectedSampleDistinct(mid) < sampleDistinct ? low : high) = mid;
+    }
+    estimatedDistinct = high;
+  }
+
+  double hashTableSize = estimatedDistinct * hashEntrySize * 4 / 3;
+  // Once the hash table outgrows the cache, more and more probes go to slower
+  // levels of the memory hierarchy
+  double hashCost = hashCostInCache + hashCostPerCacheDoubling * max(0.0, log2(hashTableSize / cacheSize));
+  // Besides one pass per significant byte, the sort needs the passes to
+  // set up the keys and to find the neighbors
+  auto rangeBits = 64 - __builtin_clzll((static_cast<uint64_t>(sampleMax) - static_cast<uint64_t>(sampleMin)) | 1);
+  int64_t passes = (rangeBits + radix::digitBits - 1) / radix::digitBits + 2;
+  double sortCost = passes * sortCostPerPass / parallel::chunkCount(n, radix::minChunkSize);
+  return sortCost < hashCost;
+}
+
+
+/// For each row, computes 1 + the position of the previous row with the same value, or 0 if there is none
+inline std::vector<int64_t> computePrevOffsets(const std::vector<int64_t>& inputData) {
+  if (preferSortForPrevOffsets(inputData)) {
+    return computePrevOffsetsSort(inputData);
+  } else {
+    return computePrevOffsetsHash(inputData);
+  }
+}
+
+
+/// With `packed`, the tree levels are stored compressed
+template<int64_t fanout, int64_t cascading, bool packed = false, typename T1, typename T2>
 std::vector<int64_t> mergesortCountDistinct(const std::vector<int64_t>& inputData, T1 lowerBound, T2 upperBound) {
   using namespace std;
-  auto mergeSortTree = MergeSortTree<fanout, cascading, int64_t>{computePrevOffsets(inputData)};
+  using LevelT = conditional_t<packed, PackedLevel<int64_t>, vector<int64_t>>;
+  auto mergeSortTree = MergeSortTree<fanout, cascading, int64_t, int64_t, LevelT>{computePrevOffsets(inputData)};
 
   vector<int64_t> result;
   result.reserve(inputData.size());
   for (size_t i = 0; i < inputData.size(); ++i) {
     int64_t lower = lowerBound(i, inputData.size());
     int64_t upper = upperBound(i, inputData.size());
+    if (lower >= upper) {
+      result.push_back(0);
+      continue;
+    }
     int64_t countDistinct = mergeSortTree.aggregateLowerBoundSum(lower, upper, lower + 1);
     result.push_back(countDistinct);
   }
@@ -177,57 +477,57 @@ std::vector<int64_t> mergesortCountDistinct(const std::vector<int64_t>& inputDat
 
 
 template<int64_t fanout, int64_t cascading, typename Agg, typename T1, typename T2>
-std::vector<int64_t> mergesortAggregateDistinct(const std::vector<int64_t>& inputData, T1 lowerBound, T2 upperBound) {
+std::vector<typename Agg::ResultType> mergesortAggregateDistinct(const std::vector<int64_t>& inputData, T1 lowerBound, T2 upperBound) {
   using namespace std;
-  MergeSortTree<fanout, cascading, int64_t> mergeSortTree;
+  // For each level, the running aggregates over the values which are the first
+  // occurrence within their run. They are computed while the tree is merged.
   vector<vector<typename Agg::StateType>> runningAggs;
-  {
-    auto prevOffsets = computePrevOffsets(inputData);
-    vector<tuple<int64_t, int64_t>> zippedPrevOffsets;
-    zippedPrevOffsets.reserve(prevOffsets.size());
-    for (size_t i = 0; i < prevOffsets.size(); ++i) {
-      zippedPrevOffsets.emplace_back(prevOffsets[i], inputData[i]);
-    }
-    auto zippedMergeSortTree = MergeSortTree<fanout, cascading, tuple<int64_t, int64_t>>(move(zippedPrevOffsets));
-
-    mergeSortTree.tree.reserve(zippedMergeSortTree.tree.size());
-    runningAggs.reserve(zippedMergeSortTree.tree.size());
-    int64_t levelWidth = 1;
-    for (int64_t levelNr = 0; levelNr < zippedMergeSortTree.tree.size(); ++levelNr) {
-      auto& zippedLevel = zippedMergeSortTree.tree[levelNr].first;
-      vector<int64_t> level;
-      vector<typename Agg::StateType> levelAggs;
-      level.reserve(zippedLevel.size());
-      levelAggs.reserve(zippedLevel.size());
-      for (size_t i = 0; i < zippedLevel.size(); i += levelWidth) {
-        auto nextLimit = min(zippedLevel.size(), i + levelWidth);
-        auto aggState = Agg::init();
-        for (int64_t j = i; j < nextLimit; ++j) {
-          level.push_back(get<0>(zippedLevel[j]));
-          if (get<0>(zippedLevel[j]) < i+1) aggState = Agg::mergeValue(aggState, get<1>(zippedLevel[j]));
-          levelAggs.push_back(aggState);
-        }
-      }
-      mergeSortTree.tree.emplace_back(move(level), move(zippedMergeSortTree.tree[levelNr].second));
-      runningAggs.push_back(move(levelAggs));
-      levelWidth *= fanout;
+  auto runningState = Agg::init();
+  auto computeRunningAggs = [&](int64_t level, int64_t runBegin, int64_t pos, int64_t prevOffset, int64_t value) {
+    if (level == static_cast<int64_t>(runningAggs.size())) {
+      runningAggs.emplace_back();
+      runningAggs.back().reserve(inputData.size());
     }
-  }
+    if (pos == runBegin) runningState = Agg::init();
+    if (prevOffset < runBegin + 1) runningState = Agg::mergeValue(runningState, value);
+    runningAggs[level].push_back(runningState);
+  };
+  auto mergeSortTree = MergeSortTree<fanout, cascading, int64_t>(computePrevOffsets(inputData), vector<int64_t>(inputData), computeRunningAggs);
 
-  vector<int64_t> result;
+  vector<typename Agg::ResultType> result;
   result.reserve(inputData.size());
   for (size_t i = 0; i < inputData.size(); ++i) {
     int64_t lower = lowerBound(i, inputData.size());
     int64_t upper = upperBound(i, inputData.size());
     // Compute COUNT DISTINCT using mergesort tree
     auto aggState = Agg::init();
-    mergeSortTree.aggregateLowerBound(lower, upper, lower + 1, [&](int64_t level, const auto* begin, const auto* pos) {
+    if (lower >= upper) {
+      result.push_back(Agg::finalize(aggState));
+      continue;
+    }
+    mergeSortTree.aggregateLowerBound(lower, upper, lower + 1, [&](int64_t level, int64_t begin, int64_t pos) {
       if (pos != begin) {
-        //cerr << " " << level << " " << from << " " << to << ": " << (pos - begin) << " -> " <<  runningAggs[level][pos - mergeSortTree[level].data()] << endl;
-        aggState = Agg::merge(aggState, runningAggs[level][pos - mergeSortTree.tree[level].first.data() - 1]);
+        aggState = Agg::merge(aggState, runningAggs[level][pos - 1]);
       }
     });
-    result.push_back(aggState);
+    result.push_back(Agg::finalize(aggState));
   }
   return result;
 }
+
+
+/// Computes the distinct aggregates `Aggs` over the same frames. All of them share
+/// one tree and one traversal per row. Returns one result vector per aggregate.
+template<int64_t fanout, int64_t cascading, typename... Aggs, typename T1, typename T2>
+std::tuple<std::vector<typename Aggs::ResultType>...> mergesortAggregatesDistinct(const std::vector<int64_t>& inputData, T1 lowerBound, T2 upperBound) {
+  using namespace std;
+  auto combinedResults = mergesortAggregateDistinct<fanout, cascading, aggregates::combined<Aggs...>>(inputData, lowerBound, upperBound);
+  tuple<vector<typename Aggs::ResultType>...> results;
+  apply([&](auto&... resultVectors) { (resultVectors.reserve(combinedResults.size()), ...); }, results);
+  for (auto& rowResults : combinedResults) {
+    apply([&](auto&... resultVectors) {
+      apply([&](auto&... rowResult) { (resultVectors.push_back(move(rowResult)), ...); }, rowResults);
+    }, results);
+  }
+  return results;
+}
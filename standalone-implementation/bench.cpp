@@ -106,15 +106,31 @@ int main(int argc, const char** argv) {
       auto correctResult = naivePercentile(data, lower, upper, 0.5);
       testAlgorithm("naive", correctResult, [&data, lower, upper]() { return naivePercentile(data, lower, upper, 0.5); });
       testAlgorithm("incremental", correctResult, [&data, lower, upper]() { return incrementalPercentile(data, lower, upper, 0.5); });
-      testAlgorithm("merge2,0", correctResult, [&data, lower, upper]() { return mergesortPercentile<2,0>(data, lower, upper, 0.5); });
-      testAlgorithm("merge2,1", correctResult, [&data, lower, upper]() { return mergesortPercentile<2,1>(data, lower, upper, 0.5); });
-      testAlgorithm("merge2,4", correctResult, [&data, lower, upper]() { return mergesortPercentile<2,4>(data, lower, upper, 0.5); });
-      testAlgorithm("merge3,9", correctResult, [&data, lower, upper]() { return mergesortPercentile<3,9>(data, lower, upper, 0.5); });
-      testAlgorithm("merge3,1", correctResult, [&data, lower, upper]() { return mergesortPercentile<3,1>(data, lower, upper, 0.5); });
+      testAlgorithm("countedbtree", correctResult, [&data, lower, upper]() { return countedBTreePercentile(data, lower, upper, 0.5); });
+      testAlgorithm("auto2,0", correctResult, [&data, lower, upper]() { return mergesortPercentile<2,0>(data, lower, upper, 0.5); });
+      testAlgorithm("merge2,0", correctResult, [&data, lower, upper]() { return mergesortPercentile<2,0,false,false>(data, lower, upper, 0.5); });
+      testAlgorithm("merge2,1", correctResult, [&data, lower, upper]() { return mergesortPercentile<2,1,false,false>(data, lower, upper, 0.5); });
+      testAlgorithm("merge2,4", correctResult, [&data, lower, upper]() { return mergesortPercentile<2,4,false,false>(data, lower, upper, 0.5); });
+      testAlgorithm("merge3,9", correctResult, [&data, lower, upper]() { return mergesortPercentile<3,9,false,false>(data, lower, upper, 0.5); });
+      testAlgorithm("merge3,1", correctResult, [&data, lower, upper]() { return mergesortPercentile<3,1,false,false>(data, lower, upper, 0.5); });
       cout << endl;
     }
   };
 
+  // With a TPC-H `lineitem` file, only run on its prices
+  if (argc == 2) {
+    vector<int64_t> prices;
+    try {
+      prices = data::lineitemPrices(argv[1]);
+    } catch (const std::exception& e) {
+      cerr << e.what() << '\n';
+      return 1;
+    }
+    cout << "lineitem " << prices.size() << ", 1000 preceding, currentRow:\n";
+    execScenario(prices, framebounds::nPreceding<1000>, framebounds::untilCurrentRow);
+    return 0;
+  }
+
   /*
   for (int i = 0; i < 2000; ++i) {
     cerr << i << endl;
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include "memorypolicy.hpp"
+
+/// The fractional cascading pointers of one level of a `MergeSortTree`.
+///
+/// A pointer never leaves the run it belongs to, so we store it relative to
+/// the begin of that run. This needs 16 bits for runs shorter than 64K
+/// elements and 32 bits for runs shorter than 4G elements, instead of a full
+/// `IdxT` for an absolute position into the child level.
+struct CascadingOffsets {
+  private:
+  /// Only the array matching the entry width is allocated, following the `memorypolicy`
+  memorypolicy::UniqueArray<uint16_t> narrow;
+  memorypolicy::UniqueArray<uint32_t> medium;
+  memorypolicy::UniqueArray<uint64_t> wide;
+  int64_t entryBytes = 0;
+  int64_t entryCnt = 0;
+  int64_t entriesPerRun = 1;
+  int64_t runLength = 0;
+
+  public:
+  /// Constructor
+  CascadingOffsets() {}
+  /// Constructor for the pointers of a level of `levelSize` elements, split
+  /// into runs of `runLength` elements with `entriesPerRun` entries each
+  CascadingOffsets(int64_t levelSize, int64_t runLength, int64_t entriesPerRun)
+    : entryCnt((levelSize + runLength - 1) / runLength * entriesPerRun), entriesPerRun(entriesPerRun), runLength(runLength) {
+    // A pointer may also point to the end of its run
+    auto maxOffset = static_cast<uint64_t>(std::min(runLength, levelSize));
+    if (maxOffset <= std::numeric_limits<uint16_t>::max()) {
+      entryBytes = sizeof(uint16_t);
+      narrow = memorypolicy::makeUniqueArray<uint16_t>(entryCnt);
+    } else if (maxOffset <= std::numeric_limits<uint32_t>::max()) {
+      entryBytes = sizeof(uint32_t);
+      medium = memorypolicy::makeUniqueArray<uint32_t>(entryCnt);
+    } else {
+      entryBytes = sizeof(uint64_t);
+      wide = memorypolicy::makeUniqueArray<uint64_t>(entryCnt);
+    }
+  }
+
+  explicit operator bool() const { return entryBytes != 0; }
+  int64_t size() const { return entryCnt; }
+  /// Number of bytes per entry
+  int64_t entryWidth() const { return entryBytes; }
+  /// Size of the pointers in bytes
+  int64_t memoryUsage() const { return entryCnt * entryBytes; }
+
+  /// Returns the absolute position in the child level entry `idx` points to
+  int64_t operator[](int64_t idx) const {
+    return position(idx, idx / entriesPerRun * runLength);
+  }
+
+  /// Same as `operator[]`, but avoids a division if the caller already
+  /// knows the begin of the run the entry belongs to
+  int64_t position(int64_t idx, int64_t runBegin) const {
+    switch (entryBytes) {
+      case sizeof(uint16_t): return runBegin + narrow[idx];
+      case sizeof(uint32_t): return runBegin + medium[idx];
+      default: return runBegin + wide[idx];
+    }
+  }
+
+  /// Sets entry `idx` of the run beginning at `runBegin` to point to the
+  /// absolute position `pos` in the child level
+  void set(int64_t idx, int64_t runBegin, int64_t pos) {
+    auto offset = pos - runBegin;
+    assert(idx / entriesPerRun * runLength == runBegin);
+    assert(offset >= 0 && offset <= runLength);
+    switch (entryBytes) {
+      case sizeof(uint16_t): narrow[idx] = offset; break;
+      case sizeof(uint32_t): medium[idx] = offset; break;
+      default: wide[idx] = offset; break;
+    }
+  }
+};
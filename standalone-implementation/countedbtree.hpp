@@ -0,0 +1,403 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/// A B+-tree over unique keys which knows the number of keys below each child,
+/// so it can select the `k`th smallest key. Inserting, erasing and selecting
+/// take `O(log size)` and touch one node per level. The keys of a leaf and the
+/// separators and counts of an inner node are stored contiguously, so the
+/// searches within a node stay within a few cache lines. Keys are ordered by
+/// `Comp`. Nodes come from per-tree pools instead of one allocation each.
+template<typename KeyT, int64_t leafCapacity = 64, int64_t innerCapacity = 32, typename Comp = std::less<KeyT>>
+class CountedBTree {
+  static_assert(leafCapacity >= 4 && innerCapacity >= 4, "nodes must be splittable into halves of at least two entries");
+
+  struct Node {
+    bool isLeaf;
+    /// Number of keys of a leaf or children of an inner node
+    int64_t size = 0;
+  };
+  struct Leaf : Node {
+    std::array<KeyT, leafCapacity> keys;
+    Leaf() : Node{true} {}
+  };
+  struct Inner : Node {
+    /// `separators[i]` is at most the smallest key of child `i` and greater
+    /// than all keys of child `i - 1`. `separators[0]` is unused.
+    std::array<KeyT, innerCapacity> separators;
+    /// Number of keys below each child
+    std::array<int64_t, innerCapacity> counts;
+    std::array<Node*, innerCapacity> children;
+    Inner() : Node{false} {}
+  };
+
+  /// Hands out the nodes of one type from blocks of growing size. Released
+  /// nodes are reused first, and `releaseAll` recycles all blocks at once.
+  template<typename NodeT>
+  class NodePool {
+    static constexpr int64_t maxBlockSize = 1024;
+    std::vector<std::unique_ptr<NodeT[]>> blocks;
+    std::vector<NodeT*> released;
+    /// Number of blocks in use. Nodes are carved out of the last one.
+    size_t usedBlocks = 0;
+    int64_t usedNodes = 0, blockSize = 0;
+
+    public:
+    NodeT* allocate() {
+      NodeT* node;
+      if (!released.empty()) {
+        node = released.back();
+        released.pop_back();
+      } else {
+        if (usedNodes == blockSize) {
+          // Doubles up to `maxBlockSize`, which all later blocks keep
+          blockSize = std::min<int64_t>(maxBlockSize, blockSize ? 2 * blockSize : 4);
+          if (usedBlocks == blocks.size()) blocks.emplace_back(new NodeT[blockSize]);
+          ++usedBlocks;
+          usedNodes = 0;
+        }
+        node = &blocks[usedBlocks - 1][usedNodes++];
+      }
+      node->size = 0;
+      return node;
+    }
+    void release(NodeT* node) { released.push_back(node); }
+    void releaseAll() {
+      released.clear();
+      usedBlocks = 0;
+      usedNodes = blockSize = 0;
+    }
+  };
+
+  NodePool<Leaf> leaves;
+  NodePool<Inner> inners;
+  Node* root;
+  int64_t keyCnt = 0;
+  Comp comp;
+
+  static Leaf* asLeaf(Node* node) { return static_cast<Leaf*>(node); }
+  static Inner* asInner(Node* node) { return static_cast<Inner*>(node); }
+  void release(Node* node) {
+    if (node->isLeaf) leaves.release(asLeaf(node)); else inners.release(asInner(node));
+  }
+  static int64_t countKeys(Node* node);
+  /// Index of the child of `node` whose keys span `key`
+  int64_t childIdx(const Inner* node, const KeyT& key) const {
+    return std::upper_bound(node->separators.begin() + 1, node->separators.begin() + node->size, key, comp) - node->separators.begin() - 1;
+  }
+  /// Inserts `key` below `node`. If `node` had to be split, returns the new
+  /// right half and sets `separator` to its separator.
+  Node* insert(Node* node, const KeyT& key, KeyT& separator);
+  /// Erases `key` below `node`. Returns whether `node` is less than half full.
+  bool erase(Node* node, const KeyT& key);
+  /// Refills child `idx` of `parent`, which is less than half full, from a sibling
+  void rebalance(Inner* parent, int64_t idx);
+
+  public:
+  /// Constructor
+  explicit CountedBTree(Comp comp = {}) : root(leaves.allocate()), comp(comp) {}
+  CountedBTree(const CountedBTree&) = delete;
+  CountedBTree& operator=(const CountedBTree&) = delete;
+
+  int64_t size() const { return keyCnt; }
+  bool empty() const { return !keyCnt; }
+
+  /// Inserts `key`, which must not be in the tree yet
+  void insert(const KeyT& key);
+  /// Erases `key`, which must be in the tree
+  void erase(const KeyT& key);
+  /// Erases all keys
+  void clear();
+  /// Replaces all keys by those of `[begin, end)`, which must be sorted and
+  /// unique. Builds the tree bottom-up in `O(end - begin)` instead of inserting
+  /// the keys one by one, and leaves room in the nodes for later inserts.
+  template<typename IterT>
+  void assign(IterT begin, IterT end);
+  /// Returns the `k`th smallest key, counting from 0
+  const KeyT& select(int64_t k) const;
+};
+
+template<typename KeyT, int64_t leafCapacity, int64_t innerCapacity, typename Comp>
+int64_t CountedBTree<KeyT, leafCapacity, innerCapacity, Comp>::countKeys(Node* node) {
+  if (node->isLeaf) return node->size;
+  auto inner = asInner(node);
+  int64_t result = 0;
+  for (int64_t i = 0; i < inner->size; ++i) result += inner->counts[i];
+  return result;
+}
+
+template<typename KeyT, int64_t leafCapacity, int64_t innerCapacity, typename Comp>
+auto CountedBTree<KeyT, leafCapacity, innerCapacity, Comp>::insert(Node* node, const KeyT& key, KeyT& separator) -> Node* {
+  using namespace std;
+  if (node->isLeaf) {
+    auto leaf = asLeaf(node);
+    auto target = leaf;
+    Leaf* right = nullptr;
+    if (leaf->size == leafCapacity) {
+      // Move the upper half to a new leaf and insert into the matching half
+      right = leaves.allocate();
+      constexpr int64_t half = leafCapacity / 2;
+      move(leaf->keys.begin() + half, leaf->keys.end(), right->keys.begin());
+      leaf->size = half;
+      right->size = leafCapacity - half;
+      if (!comp(key, right->keys[0])) target = right;
+    }
+    auto pos = lower_bound(target->keys.begin(), target->keys.begin() + target->size, key, comp);
+    assert(pos == target->keys.begin() + target->size || comp(key, *pos));
+    move_backward(pos, target->keys.begin() + target->size, target->keys.begin() + target->size + 1);
+    *pos = key;
+    ++target->size;
+    if (right) separator = right->keys[0];
+    return right;
+  }
+  auto inner = asInner(node);
+  auto idx = childIdx(inner, key);
+  ++inner->counts[idx];
+  KeyT childSeparator;
+  Node* newChild = insert(inner->children[idx], key, childSeparator);
+  if (!newChild) return nullptr;
+  // The child was split, so we need to insert its new right half after it
+  auto target = inner;
+  Inner* right = nullptr;
+  int64_t insertIdx = idx + 1;
+  if (inner->size == innerCapacity) {
+    right = inners.allocate();
+    constexpr int64_t half = innerCapacity / 2;
+    move(inner->separators.begin() + half, inner->separators.end(), right->separators.begin());
+    move(inner->counts.begin() + half, inner->counts.end(), right->counts.begin());
+    move(inner->children.begin() + half, inner->children.end(), right->children.begin());
+    inner->size = half;
+    right->size = innerCapacity - half;
+    if (insertIdx > half) {
+      target = right;
+      insertIdx -= half;
+    }
+  }
+  auto shift = [&](auto& array) {
+    move_backward(array.begin() + insertIdx, array.begin() + target->size, array.begin() + target->size + 1);
+  };
+  shift(target->separators);
+  shift(target->counts);
+  shift(target->children);
+  target->separators[insertIdx] = childSeparator;
+  target->children[insertIdx] = newChild;
+  target->counts[insertIdx] = countKeys(newChild);
+  ++target->size;
+  // The split child lost the keys its new right half took. It always ends up
+  // next to its right half, as we only move `insertIdx` to `right` if `idx` moves, too.
+  target->counts[insertIdx - 1] = countKeys(target->children[insertIdx - 1]);
+  if (right) separator = right->separators[0];
+  return right;
+}
+
+template<typename KeyT, int64_t leafCapacity, int64_t innerCapacity, typename Comp>
+void CountedBTree<KeyT, leafCapacity, innerCapacity, Comp>::insert(const KeyT& key) {
+  KeyT separator;
+  Node* right = insert(root, key, separator);
+  if (right) {
+    auto newRoot = inners.allocate();
+    newRoot->size = 2;
+    newRoot->children[0] = root;
+    newRoot->children[1] = right;
+    newRoot->separators[1] = separator;
+    newRoot->counts[0] = countKeys(root);
+    newRoot->counts[1] = countKeys(right);
+    root = newRoot;
+  }
+  ++keyCnt;
+}
+
+template<typename KeyT, int64_t leafCapacity, int64_t innerCapacity, typename Comp>
+bool CountedBTree<KeyT, leafCapacity, innerCapacity, Comp>::erase(Node* node, const KeyT& key) {
+  using namespace std;
+  if (node->isLeaf) {
+    auto leaf = asLeaf(node);
+    auto end = leaf->keys.begin() + leaf->size;
+    auto pos = lower_bound(leaf->keys.begin(), end, key, comp);
+    assert(pos != end && !comp(key, *pos));
+    move(pos + 1, end, pos);
+    --leaf->size;
+    return leaf->size < leafCapacity / 2;
+  }
+  auto inner = asInner(node);
+  auto idx = childIdx(inner, key);
+  --inner->counts[idx];
+  if (erase(inner->children[idx], key)) rebalance(inner, idx);
+  return inner->size < innerCapacity / 2;
+}
+
+template<typename KeyT, int64_t leafCapacity, int64_t innerCapacity, typename Comp>
+void CountedBTree<KeyT, leafCapacity, innerCapacity, Comp>::rebalance(Inner* parent, int64_t idx) {
+  using namespace std;
+  if (parent->size < 2) return;
+  int64_t leftIdx = idx > 0 ? idx - 1 : idx;
+  int64_t rightIdx = leftIdx + 1;
+  Node* left = parent->children[leftIdx];
+  Node* right = parent->children[rightIdx];
+  int64_t capacity = left->isLeaf ? leafCapacity : innerCapacity;
+  int64_t total = left->size + right->size;
+  if (total <= capacity) {
+    // Merge the right node into the left one
+    if (left->isLeaf) {
+      move(asLeaf(right)->keys.begin(), asLeaf(right)->keys.begin() + right->size, asLeaf(left)->keys.begin() + left->size);
+      leaves.release(asLeaf(right));
+    } else {
+      auto l = asInner(left), r = asInner(right);
+      r->separators[0] = parent->separators[rightIdx];
+      move(r->separators.begin(), r->separators.begin() + r->size, l->separators.begin() + l->size);
+      move(r->counts.begin(), r->counts.begin() + r->size, l->counts.begin() + l->size);
+      move(r->children.begin(), r->children.begin() + r->size, l->children.begin() + l->size);
+      inners.release(r);
+    }
+    left->size = total;
+    parent->counts[leftIdx] += parent->counts[rightIdx];
+    auto remove = [&](auto& array) {
+      move(array.begin() + rightIdx + 1, array.begin() + parent->size, array.begin() + rightIdx);
+    };
+    remove(parent->separators);
+    remove(parent->counts);
+    remove(parent->children);
+    --parent->size;
+    return;
+  }
+  // Split the entries evenly between both nodes
+  int64_t leftSize = total / 2;
+  int64_t moved = left->size - leftSize;
+  if (left->isLeaf) {
+    auto l = asLeaf(left), r = asLeaf(right);
+    if (moved > 0) {
+      move_backward(r->keys.begin(), r->keys.begin() + r->size, r->keys.begin() + r->size + moved);
+      move(l->keys.begin() + leftSize, l->keys.begin() + l->size, r->keys.begin());
+    } else {
+      move(r->keys.begin(), r->keys.begin() - moved, l->keys.begin() + l->size);
+      move(r->keys.begin() - moved, r->keys.begin() + r->size, r->keys.begin());
+    }
+    parent->separators[rightIdx] = r->keys[0];
+  } else {
+    auto l = asInner(left), r = asInner(right);
+    r->separators[0] = parent->separators[rightIdx];
+    if (moved > 0) {
+      auto prepend = [&](auto& from, auto& to) {
+        move_backward(to.begin(), to.begin() + r->size, to.begin() + r->size + moved);
+        move(from.begin() + leftSize, from.begin() + l->size, to.begin());
+      };
+      prepend(l->separators, r->separators);
+      prepend(l->counts, r->counts);
+      prepend(l->children, r->children);
+    } else {
+      auto append = [&](auto& from, auto& to) {
+        move(from.begin(), from.begin() - moved, to.begin() + l->size);
+        move(from.begin() - moved, from.begin() + r->size, from.begin());
+      };
+      append(r->separators, l->separators);
+      append(r->counts, l->counts);
+      append(r->children, l->children);
+    }
+    parent->separators[rightIdx] = r->separators[0];
+  }
+  left->size = leftSize;
+  right->size = total - leftSize;
+  parent->counts[leftIdx] = countKeys(left);
+  parent->counts[rightIdx] = countKeys(right);
+}
+
+template<typename KeyT, int64_t leafCapacity, int64_t innerCapacity, typename Comp>
+void CountedBTree<KeyT, leafCapacity, innerCapacity, Comp>::erase(const KeyT& key) {
+  assert(keyCnt > 0);
+  erase(root, key);
+  // Drop roots which only have a single child left
+  while (!root->isLeaf && root->size == 1) {
+    auto oldRoot = asInner(root);
+    root = oldRoot->children[0];
+    inners.release(oldRoot);
+  }
+  --keyCnt;
+}
+
+template<typename KeyT, int64_t leafCapacity, int64_t innerCapacity, typename Comp>
+void CountedBTree<KeyT, leafCapacity, innerCapacity, Comp>::clear() {
+  leaves.releaseAll();
+  inners.releaseAll();
+  root = leaves.allocate();
+  keyCnt = 0;
+}
+
+template<typename KeyT, int64_t leafCapacity, int64_t innerCapacity, typename Comp>
+template<typename IterT>
+void CountedBTree<KeyT, leafCapacity, innerCapacity, Comp>::assign(IterT begin, IterT end) {
+  using namespace std;
+  assert(adjacent_find(begin, end, [&](const KeyT& a, const KeyT& b) { return !comp(a, b); }) == end);
+  clear();
+  int64_t n = end - begin;
+  if (!n) return;
+  keyCnt = n;
+  // Fill the nodes to 3/4 of their capacity, but never below half, so that
+  // neither the next inserts nor the next erases restructure the tree at once
+  auto nodeCnt = [](int64_t entryCnt, int64_t capacity) {
+    int64_t fill = capacity * 3 / 4;
+    return clamp<int64_t>((entryCnt + fill - 1) / fill, 1, max<int64_t>(1, entryCnt / (capacity / 2)));
+  };
+  // The nodes of the level built last, with their smallest keys and key counts
+  vector<Node*> nodes;
+  vector<KeyT> mins;
+  vector<int64_t> counts;
+  int64_t leafCnt = nodeCnt(n, leafCapacity);
+  nodes.reserve(leafCnt);
+  mins.reserve(leafCnt);
+  counts.reserve(leafCnt);
+  for (int64_t i = 0; i < leafCnt; ++i) {
+    auto leaf = leaves.allocate();
+    auto first = begin + n * i / leafCnt, last = begin + n * (i + 1) / leafCnt;
+    copy(first, last, leaf->keys.begin());
+    leaf->size = last - first;
+    nodes.push_back(leaf);
+    mins.push_back(*first);
+    counts.push_back(leaf->size);
+  }
+  while (nodes.size() > 1) {
+    int64_t childCnt = nodes.size();
+    int64_t parentCnt = nodeCnt(childCnt, innerCapacity);
+    // Each parent starts at or after its first child, so we can overwrite the
+    // children's entries in place
+    for (int64_t i = 0; i < parentCnt; ++i) {
+      auto inner = inners.allocate();
+      int64_t first = childCnt * i / parentCnt, last = childCnt * (i + 1) / parentCnt;
+      int64_t count = 0;
+      for (int64_t j = first; j < last; ++j) {
+        inner->separators[j - first] = mins[j];
+        inner->counts[j - first] = counts[j];
+        inner->children[j - first] = nodes[j];
+        count += counts[j];
+      }
+      inner->size = last - first;
+      nodes[i] = inner;
+      mins[i] = inner->separators[0];
+      counts[i] = count;
+    }
+    nodes.resize(parentCnt);
+    mins.resize(parentCnt);
+    counts.resize(parentCnt);
+  }
+  leaves.release(asLeaf(root));
+  root = nodes[0];
+}
+
+template<typename KeyT, int64_t leafCapacity, int64_t innerCapacity, typename Comp>
+const KeyT& CountedBTree<KeyT, leafCapacity, innerCapacity, Comp>::select(int64_t k) const {
+  assert(k >= 0 && k < keyCnt);
+  Node* node = root;
+  while (!node->isLeaf) {
+    auto inner = asInner(node);
+    int64_t idx = 0;
+    while (k >= inner->counts[idx]) k -= inner->counts[idx++];
+    node = inner->children[idx];
+  }
+  return asLeaf(node)->keys[k];
+}
@@ -1,6 +1,12 @@
 #include <vector>
+#include <algorithm>
 #include <cstdint>
+#include <cmath>
+#include <numeric>
 #include <random>
+#include <string>
+#include "lineitem.hpp"
+#include "radixsort.hpp"
 
 namespace data {
   static const std::vector<int64_t> values10 = {
@@ -21,5 +27,21 @@ namespace data {
     }
     return data;
   }
-}
 
+  /// `l_extendedprice` in cents of the TPC-H `lineitem` file at `path`, in
+  /// `l_shipdate` order. See `lineitem::load` for the supported formats.
+  inline std::vector<int64_t> lineitemPrices(const std::string& path) {
+    auto table = lineitem::load(path, {lineitem::Column::ShipDate, lineitem::Column::ExtendedPrice});
+    std::vector<int64_t> rows(table.rowCnt), order(table.rowCnt);
+    std::iota(rows.begin(), rows.end(), 0);
+    auto shipDate = [&](int64_t row) { return table.shipDate[row]; };
+    if (!radix::countingSort(rows.data(), order.data(), table.rowCnt, shipDate)) {
+      order = rows;
+      std::stable_sort(order.begin(), order.end(), [&](int64_t a, int64_t b) { return shipDate(a) < shipDate(b); });
+    }
+    std::vector<int64_t> prices;
+    prices.reserve(table.rowCnt);
+    for (auto row : order) prices.push_back(std::llround(table.extendedPrice[row] * 100));
+    return prices;
+  }
+}
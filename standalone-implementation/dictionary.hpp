@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "parallel.hpp"
+
+/// The value reported for empty frames
+template<typename T>
+T emptyValue() {
+  if constexpr (std::is_integral_v<T>) {
+    return ~T{0};
+  } else if constexpr (std::is_floating_point_v<T>) {
+    return std::numeric_limits<T>::quiet_NaN();
+  } else {
+    return T{};
+  }
+}
+
+
+/// Order-preserving dictionary encoding.
+///
+/// Maps each value to the rank of the value among all distinct values, i.e.
+/// `a < b` iff `code(a) < code(b)`. The tree algorithms can then work on
+/// dense integer codes independent of the source type, and only the final
+/// results need to be decoded.
+template<typename T>
+struct Dictionary {
+  /// Below this size, a chunk isn't worth its own thread
+  static constexpr int64_t minChunkSize = 16 * 1024;
+
+  /// The distinct values in ascending order. A code is an index into this vector
+  std::vector<T> values;
+  /// The code of each input value
+  std::vector<int64_t> codes;
+
+  /// Constructor
+  explicit Dictionary(const std::vector<T>& inputData);
+
+  /// Returns the value for `code`. Negative codes denote an empty result
+  T decode(int64_t code) const { return code < 0 ? emptyValue<T>() : values[code]; }
+  /// Decodes all `codes`
+  std::vector<T> decode(const std::vector<int64_t>& codes) const;
+};
+
+template<typename T>
+Dictionary<T>::Dictionary(const std::vector<T>& inputData) {
+  using namespace std;
+  int64_t n = inputData.size();
+  // Sort and deduplicate each chunk on its own thread
+  auto chunkCnt = parallel::chunkCount(n, minChunkSize);
+  vector<vector<T>> chunkValues(chunkCnt);
+  parallel::forEachChunk(n, minChunkSize, [&](int64_t chunkIdx, int64_t begin, int64_t end) {
+    auto& chunk = chunkValues[chunkIdx];
+    chunk.assign(inputData.begin() + begin, inputData.begin() + end);
+    sort(chunk.begin(), chunk.end());
+    chunk.erase(unique(chunk.begin(), chunk.end()), chunk.end());
+  });
+  // Merge the chunk dictionaries pairwise, again in parallel
+  for (int64_t step = 1; step < chunkCnt; step *= 2) {
+    int64_t mergeCnt = (chunkCnt + 2 * step - 1) / (2 * step);
+    parallel::forEachTask(mergeCnt, [&](int64_t mergeIdx) {
+      auto left = mergeIdx * 2 * step;
+      auto right = left + step;
+      if (right >= chunkCnt) return;
+      vector<T> merged;
+      merged.reserve(chunkValues[left].size() + chunkValues[right].size());
+      set_union(chunkValues[left].begin(), chunkValues[left].end(),
+                chunkValues[right].begin(), chunkValues[right].end(), back_inserter(merged));
+      chunkValues[left] = move(merged);
+      chunkValues[right] = {};
+    });
+  }
+  if (chunkCnt) values = move(chunkValues[0]);
+  // Look up the codes
+  codes.resize(n);
+  parallel::forEachChunk(n, minChunkSize, [&](int64_t, int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; ++i) {
+      codes[i] = lower_bound(values.begin(), values.end(), inputData[i]) - values.begin();
+    }
+  });
+}
+
+template<typename T>
+std::vector<T> Dictionary<T>::decode(const std::vector<int64_t>& codes) const {
+  std::vector<T> result(codes.size());
+  parallel::forEachChunk(codes.size(), minChunkSize, [&](int64_t, int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; ++i) result[i] = decode(codes[i]);
+  });
+  return result;
+}
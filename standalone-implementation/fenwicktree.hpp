@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/// A Fenwick tree (binary indexed tree) over `size` counters, all initially zero.
+/// Adding to a counter and summing up a prefix of the counters take `O(log size)`.
+template<typename CountT = int64_t>
+struct FenwickTree {
+  private:
+  /// `sums[i - 1]` is the sum of the counters in `[i - (i & -i), i)`
+  std::vector<CountT> sums;
+
+  public:
+  /// Constructor
+  explicit FenwickTree(int64_t size) : sums(size) {}
+
+  int64_t size() const { return sums.size(); }
+
+  /// Adds `delta` to counter `pos`
+  void add(int64_t pos, CountT delta) {
+    for (int64_t i = pos + 1; i <= size(); i += i & -i) sums[i - 1] += delta;
+  }
+
+  /// Sum of the counters in `[0, end)`
+  CountT prefixSum(int64_t end) const {
+    CountT sum = 0;
+    for (int64_t i = end; i > 0; i -= i & -i) sum += sums[i - 1];
+    return sum;
+  }
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <cassert>
+#include <type_traits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/// Open-addressing hash map for integral keys.
+///
+/// Slots are probed linearly. Next to the keys and values we keep one control
+/// byte per slot: either `emptyCtrl` or the low 7 bits of the key's hash. A
+/// lookup compares the control bytes of 16 consecutive slots at once and only
+/// touches the keys of slots whose hash fragment matches.
+/// Deletion uses backward-shifting instead of tombstones, so a probe sequence
+/// always ends at the first empty slot and erased entries don't slow down
+/// subsequent lookups.
+template<typename K, typename V>
+struct FlatHashMap {
+  static_assert(std::is_integral_v<K>, "FlatHashMap only supports integral keys");
+
+  static constexpr int64_t groupSize = 16;
+  static constexpr uint8_t emptyCtrl = 0x80;
+
+  private:
+  /// The control bytes. The first `groupSize - 1` bytes are mirrored behind the
+  /// end, so that a group starting close to the end can be loaded without wrapping
+  std::unique_ptr<uint8_t[]> ctrl;
+  std::unique_ptr<K[]> keys;
+  std::unique_ptr<V[]> values;
+  int64_t capacity = 0;
+  int64_t mask = 0;
+  int shift = 64;
+  int64_t count = 0;
+
+  /// Fibonacci hashing: the top bits of the product select the home slot,
+  /// the 7 bits below them form the hash fragment stored in the control byte
+  static uint64_t hash(K key) { return static_cast<uint64_t>(key) * 0x9e3779b97f4a7c15ull; }
+  uint8_t fragment(uint64_t h) const { return (h >> (shift - 7)) & 0x7f; }
+  int64_t homeSlot(uint64_t h) const { return h >> shift; }
+
+  void setCtrl(int64_t slot, uint8_t c) {
+    ctrl[slot] = c;
+    if (slot < groupSize - 1) ctrl[capacity + slot] = c;
+  }
+
+#ifdef __SSE2__
+  using Group = __m128i;
+  Group loadGroup(int64_t slot) const {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl.get() + slot));
+  }
+  /// Bitmask of the slots in `group` whose control byte equals `c`
+  static uint32_t matchGroup(Group group, uint8_t c) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(c))));
+  }
+#else
+  using Group = const uint8_t*;
+  Group loadGroup(int64_t slot) const { return ctrl.get() + slot; }
+  static uint32_t matchGroup(Group group, uint8_t c) {
+    uint32_t result = 0;
+    for (int64_t i = 0; i < groupSize; ++i) {
+      result |= static_cast<uint32_t>(group[i] == c) << i;
+    }
+    return result;
+  }
+#endif
+
+  /// Returns the slot containing `key`, or the empty slot where `key` should be inserted
+  std::pair<int64_t, bool> probe(K key) const {
+    auto h = hash(key);
+    auto frag = fragment(h);
+    int64_t slot = homeSlot(h);
+    while (true) {
+      auto group = loadGroup(slot);
+      // Matches behind the first empty slot are not part of the probe sequence.
+      // Since keys are unique, checking them anyway is harmless.
+      for (auto matches = matchGroup(group, frag); matches; matches &= matches - 1) {
+        int64_t candidate = (slot + __builtin_ctz(matches)) & mask;
+        if (keys[candidate] == key) return {candidate, true};
+      }
+      if (auto empties = matchGroup(group, emptyCtrl)) {
+        return {(slot + __builtin_ctz(empties)) & mask, false};
+      }
+      slot = (slot + groupSize) & mask;
+    }
+  }
+
+  // Kept out of line: inlining the rehash loop into `operator[]` bloats the
+  // hot insertion path and made lookups up to 4x slower in our measurements
+  __attribute__((noinline)) void rehash(int64_t newCapacity) {
+    auto oldCtrl = std::move(ctrl);
+    auto oldKeys = std::move(keys);
+    auto oldValues = std::move(values);
+    auto oldCapacity = capacity;
+    capacity = newCapacity;
+    mask = newCapacity - 1;
+    shift = __builtin_clzll(newCapacity) + 1;
+    ctrl = std::make_unique<uint8_t[]>(capacity + groupSize - 1);
+    std::memset(ctrl.get(), emptyCtrl, capacity + groupSize - 1);
+    keys = std::make_unique<K[]>(capacity);
+    values = std::make_unique<V[]>(capacity);
+    for (int64_t i = 0; i < oldCapacity; ++i) {
+      if (oldCtrl[i] != emptyCtrl) {
+        auto slot = probe(oldKeys[i]).first;
+        setCtrl(slot, fragment(hash(oldKeys[i])));
+        keys[slot] = oldKeys[i];
+        values[slot] = std::move(oldValues[i]);
+      }
+    }
+  }
+
+  public:
+  /// Constructor
+  FlatHashMap(int64_t expectedSize = 0) { reserve(expectedSize); }
+
+  /// Make room for `n` entries without rehashing
+  void reserve(int64_t n) {
+    // Keep the load factor below 3/4
+    int64_t required = groupSize;
+    while (required * 3 < n * 4) required *= 2;
+    if (required > capacity) rehash(required);
+  }
+
+  int64_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  /// Returns the value for `key`, or `nullptr` if `key` is not contained
+  V* find(K key) {
+    auto [slot, found] = probe(key);
+    return found ? &values[slot] : nullptr;
+  }
+
+  /// Returns the value for `key`, inserting a value-initialized entry if necessary
+  V& operator[](K key) {
+    auto [slot, found] = probe(key);
+    if (found) return values[slot];
+    if ((count + 1) * 4 > capacity * 3) {
+      rehash(capacity * 2);
+      slot = probe(key).first;
+    }
+    setCtrl(slot, fragment(hash(key)));
+    keys[slot] = key;
+    values[slot] = V{};
+    ++count;
+    return values[slot];
+  }
+
+  /// Removes `key`. Returns false if `key` wasn't contained
+  bool erase(K key) {
+    auto [slot, found] = probe(key);
+    if (!found) return false;
+    // Shift back subsequent entries of the probe sequence which would
+    // otherwise become unreachable
+    int64_t hole = slot;
+    for (int64_t next = (hole + 1) & mask; ctrl[next] != emptyCtrl; next = (next + 1) & mask) {
+      int64_t home = homeSlot(hash(keys[next]));
+      // Can the entry at `next` be moved into the hole, i.e. is `home`
+      // cyclically outside of `(hole, next]`?
+      if (((next - home) & mask) >= ((next - hole) & mask)) {
+        setCtrl(hole, ctrl[next]);
+        keys[hole] = keys[next];
+        values[hole] = std::move(values[next]);
+        hole = next;
+      }
+    }
+    setCtrl(hole, emptyCtrl);
+    --count;
+    return true;
+  }
+
+  /// Removes all entries but keeps the allocated memory
+  void clear() {
+    if (count) std::memset(ctrl.get(), emptyCtrl, capacity + groupSize - 1);
+    count = 0;
+  }
+
+  /// Calls `f(key, value)` for all entries
+  template<typename F>
+  void forEach(F f) const {
+    for (int64_t i = 0; i < capacity; ++i) {
+      if (ctrl[i] != emptyCtrl) f(keys[i], values[i]);
+    }
+  }
+};
@@ -13,4 +13,55 @@ namespace framebounds {
    template<int64_t n>
    int64_t nPreceding(int64_t i, int64_t end) { return (i < n) ? 0 : (i - n); }
    static int64_t oscillating(int64_t i, int64_t end) { return std::min(i%8*end/7,end); }
+
+   /// Frames which only grow if the rows are visited in the right order, so
+   /// that their results can be maintained incrementally instead of using a tree
+   enum class Growth {
+      None,
+      /// All frames start at the first row and their ends never decrease
+      Prefix,
+      /// All frames end at the last row and their begins never decrease.
+      /// They grow when visiting the rows backwards.
+      Suffix,
+   };
+
+   /// Classifies the frames of the rows `[0, end)`
+   template<typename T1, typename T2>
+   Growth growth(T1 lowerBound, T2 upperBound, int64_t end) {
+      bool prefix = true, suffix = true;
+      int64_t prevLower = 0, prevUpper = 0;
+      for (int64_t i = 0; i < end && (prefix || suffix); ++i) {
+         int64_t lower = lowerBound(i, end);
+         int64_t upper = upperBound(i, end);
+         prefix = prefix && lower == 0 && upper >= prevUpper;
+         suffix = suffix && upper == end && lower >= prevLower;
+         prevLower = lower;
+         prevUpper = upper;
+      }
+      if (prefix) return Growth::Prefix;
+      if (suffix) return Growth::Suffix;
+      return Growth::None;
+   }
+
+   /// Visits the rows `[0, end)` in the order in which their frames grow.
+   /// Before `visit(i, lower, upper)` is called for row `i`, `insert(j)` was
+   /// called exactly once for every row `j` within its frame.
+   template<typename T1, typename T2, typename I, typename V>
+   void visitGrowing(Growth growth, T1 lowerBound, T2 upperBound, int64_t end, I insert, V visit) {
+      if (growth == Growth::Prefix) {
+         int64_t inserted = 0;
+         for (int64_t i = 0; i < end; ++i) {
+            int64_t upper = upperBound(i, end);
+            for (; inserted < upper; ++inserted) insert(inserted);
+            visit(i, int64_t{0}, upper);
+         }
+      } else if (growth == Growth::Suffix) {
+         int64_t inserted = end;
+         for (int64_t i = end - 1; i >= 0; --i) {
+            int64_t lower = lowerBound(i, end);
+            while (inserted > lower) insert(--inserted);
+            visit(i, lower, end);
+         }
+      }
+   }
 }
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "cascadingoffsets.hpp"
+#include "memorypolicy.hpp"
+
+/// Storage for one level of a `MergeSortTree` which keeps the cascading
+/// pointers next to the elements they were sampled at.
+///
+/// With separate arrays, a traversal misses the cache twice per level: once
+/// when searching the level and once when reading the pointers for the found
+/// position. Here, the level is split into blocks of `cascading` elements and
+/// each block starts with the row of `fanout` pointers sampled at its first
+/// element. The pointers are thus on the same or the adjacent cache line as
+/// the position the search ended at. Blocks are padded to the next power of
+/// two if they are smaller than a cache line and to full cache lines
+/// otherwise, so that no block straddles more cache lines than necessary.
+///
+/// Blocks are numbered like the pointer rows, i.e. each run is followed by two
+/// blocks which only hold its terminator rows. Levels without cascading
+/// pointers store their elements contiguously.
+///
+/// The price is that the elements are spread over more cache lines, so the
+/// short searches between two cascading pointers often touch two blocks. In
+/// our measurements this outweighed the saved pointer miss, hence the plain
+/// vector levels remain the default.
+template<typename ElemT, int64_t fanout, int64_t cascading>
+struct InterleavedLevel {
+  static_assert(cascading > 0, "interleaving needs cascading pointers");
+  static_assert(std::is_trivially_copyable_v<ElemT>, "elements are copied bytewise");
+  static constexpr int64_t cacheLineSize = 64;
+
+  private:
+  struct AlignedDelete {
+    void operator()(char* p) const { ::operator delete[](p, std::align_val_t{cacheLineSize}); }
+  };
+  std::unique_ptr<char[], AlignedDelete> data;
+  int64_t count = 0;
+  int64_t blockCnt = 0;
+  /// Number of bytes per pointer. 0 for levels without cascading pointers
+  int64_t entryBytes = 0;
+  int64_t rowBytes = 0;
+  int64_t blockBytes = 0;
+  int64_t runLength = 1;
+  /// `log2(runLength)` if it is a power of two, otherwise -1
+  int64_t runShift = -1;
+
+  template<typename T>
+  static T load(const char* p) {
+    T x;
+    std::memcpy(&x, p, sizeof(T));
+    return x;
+  }
+  template<typename T>
+  static void store(char* p, int64_t x) {
+    T value = x;
+    std::memcpy(p, &value, sizeof(T));
+  }
+  int64_t runOf(int64_t i) const {
+    if (!entryBytes) return 0;
+    return runShift >= 0 ? i >> runShift : i / runLength;
+  }
+  /// Byte offset of element `i`, which belongs to run `runIdx`
+  int64_t elementOffset(int64_t i, int64_t runIdx) const {
+    return (i / cascading + 2 * runIdx) * blockBytes + rowBytes + (i % cascading) * static_cast<int64_t>(sizeof(ElemT));
+  }
+
+  public:
+  /// Constructor
+  InterleavedLevel() {}
+  /// Constructor for a level with runs of `runLength` elements and their
+  /// cascading pointers `offsets`, which may be empty
+  InterleavedLevel(const std::vector<ElemT>& values, const CascadingOffsets& offsets, int64_t runLength);
+
+  int64_t size() const { return count; }
+  /// Size of the level in bytes
+  int64_t memoryUsage() const { return blockCnt * blockBytes; }
+  bool hasCascadingOffsets() const { return entryBytes != 0; }
+
+  /// Returns the `i`th element
+  ElemT operator[](int64_t i) const { return load<ElemT>(data.get() + elementOffset(i, runOf(i))); }
+
+  /// Returns the position in the child level cascading pointer `idx` points
+  /// to. `runBegin` is the begin of the run the pointer belongs to.
+  int64_t cascadingPosition(int64_t idx, int64_t runBegin) const {
+    const char* entry = data.get() + (idx / fanout) * blockBytes + (idx % fanout) * entryBytes;
+    switch (entryBytes) {
+      case sizeof(uint16_t): return runBegin + load<uint16_t>(entry);
+      case sizeof(uint32_t): return runBegin + load<uint32_t>(entry);
+      default: return runBegin + load<uint64_t>(entry);
+    }
+  }
+
+  /// Index of the first element in `[begin, end)` which is not less than
+  /// `needle`. The range must be sorted and lie within a single run.
+  template<typename NeedleT>
+  int64_t lowerBound(int64_t begin, int64_t end, NeedleT needle) const {
+    auto runIdx = runOf(begin);
+    while (end - begin > cascading) {
+      int64_t middle = begin + (end - begin) / 2;
+      if (load<ElemT>(data.get() + elementOffset(middle, runIdx)) < needle) {
+        begin = middle + 1;
+      } else {
+        end = middle;
+      }
+    }
+    // The remaining range spans at most two blocks, which we scan linearly
+    while (begin < end) {
+      int64_t blockEnd = std::min(end, (begin / cascading + 1) * cascading);
+      const char* elem = data.get() + elementOffset(begin, runIdx);
+      for (; begin < blockEnd; ++begin, elem += sizeof(ElemT)) {
+        if (!(load<ElemT>(elem) < needle)) return begin;
+      }
+    }
+    return begin;
+  }
+};
+
+template<typename ElemT, int64_t fanout, int64_t cascading>
+InterleavedLevel<ElemT, fanout, cascading>::InterleavedLevel(const std::vector<ElemT>& values, const CascadingOffsets& offsets, int64_t runLength)
+  : count(values.size()), entryBytes(offsets.entryWidth()), runLength(runLength) {
+  if (!(runLength & (runLength - 1))) runShift = __builtin_ctzll(runLength);
+  rowBytes = fanout * entryBytes;
+  int64_t payloadBytes = rowBytes + cascading * sizeof(ElemT);
+  if (!entryBytes) {
+    blockBytes = payloadBytes;
+    blockCnt = (count + cascading - 1) / cascading;
+  } else {
+    blockBytes = payloadBytes < cacheLineSize
+      ? int64_t{1} << (64 - __builtin_clzll(payloadBytes - 1))
+      : (payloadBytes + cacheLineSize - 1) / cacheLineSize * cacheLineSize;
+    // Only allocate the blocks up to the terminator rows of the last run,
+    // which may be much shorter than `runLength`
+    if (count) {
+      int64_t lastRun = (count - 1) / runLength;
+      blockCnt = (count - 1) / cascading + 1 + 2 * lastRun + 2;
+    }
+  }
+  // Rounded up to full cache lines for the aligned allocation
+  int64_t allocBytes = (blockCnt * blockBytes + cacheLineSize - 1) / cacheLineSize * cacheLineSize;
+  data.reset(new (std::align_val_t{cacheLineSize}) char[allocBytes]);
+  // Zeroing is the first touch, so the pages are placed according to the policy
+  memorypolicy::apply(data.get(), allocBytes);
+  std::memset(data.get(), 0, allocBytes);
+  for (int64_t i = 0; i < count; ++i) {
+    std::memcpy(data.get() + elementOffset(i, runOf(i)), &values[i], sizeof(ElemT));
+  }
+  // Copy the pointer rows, relative to the begin of their run like in `offsets`
+  int64_t rowsPerRun = runLength / cascading + 2;
+  for (int64_t row = 0; row < blockCnt && entryBytes; ++row) {
+    int64_t runBegin = row / rowsPerRun * runLength;
+    char* block = data.get() + row * blockBytes;
+    for (int64_t child = 0; child < fanout; ++child) {
+      int64_t offset = offsets.position(row * fanout + child, runBegin) - runBegin;
+      char* entry = block + child * entryBytes;
+      switch (entryBytes) {
+        case sizeof(uint16_t): store<uint16_t>(entry, offset); break;
+        case sizeof(uint32_t): store<uint32_t>(entry, offset); break;
+        default: store<uint64_t>(entry, offset); break;
+      }
+    }
+  }
+}
+
+/// Index of the first element in `[begin, end)` which is not less than `needle`.
+/// The range must be sorted and lie within a single run.
+template<typename ElemT, int64_t fanout, int64_t cascading, typename NeedleT>
+int64_t lowerBound(const InterleavedLevel<ElemT, fanout, cascading>& level, int64_t begin, int64_t end, NeedleT needle) {
+  return level.lowerBound(begin, end, needle);
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// A small search index over a level of a `MergeSortTree`, meant to stay in cache.
+///
+/// The first search of a query covers a whole run of an upper level, i.e. a
+/// binary search over millions of elements which misses the cache on nearly
+/// every probe. The summary's lowest layer holds every k-th element of
+/// the level, and each further layer every `lineKeys`-th key of the layer
+/// below, like the inner nodes of a static B-tree. A search starts at the top
+/// layer. Each layer narrows the range to at most one cache line of keys in the
+/// layer below, and the lowest layer to k elements of the level.
+/// The level may consist of several sorted runs: searches only look at the
+/// keys sampled within the searched range.
+///
+/// A level holding consecutive integers, like the top level of a tree built
+/// `fromPermutation`, needs no keys at all: the result is computed directly.
+template<typename ElemT>
+struct LevelSummary {
+  private:
+  static constexpr int64_t floorLog2(int64_t x) { return x > 1 ? 1 + floorLog2(x / 2) : 0; }
+  /// `log2` of the number of keys per cache line, rounded down so that all
+  /// strides are powers of two
+  static constexpr int64_t lineShift = std::max<int64_t>(1, floorLog2(64 / sizeof(ElemT)));
+
+  /// `layers[0]` is the finest layer
+  std::vector<std::vector<ElemT>> layers;
+  /// `log2` of the distance between two keys of each layer
+  std::vector<int64_t> shifts;
+  /// Does the level consist of the consecutive integers starting at `first`?
+  bool dense = false;
+  ElemT first{};
+
+  public:
+  static constexpr int64_t lineKeys = int64_t{1} << lineShift;
+
+  public:
+  /// Constructor
+  LevelSummary() {}
+  /// Constructor for a summary of at most about `maxKeys` keys
+  template<typename LevelT>
+  LevelSummary(const LevelT& level, int64_t maxKeys);
+
+  bool empty() const { return layers.empty() && !dense; }
+  /// Size of the summary in bytes
+  int64_t memoryUsage() const;
+
+  /// Narrows `[begin, end)` to a range `[lo, hi)` in which the level's
+  /// `lowerBound` for `needle` returns the same result as in `[begin, end)`.
+  /// The range must be sorted. The result spans at most k elements, see above.
+  template<typename NeedleT>
+  std::pair<int64_t, int64_t> narrow(int64_t begin, int64_t end, NeedleT needle) const;
+};
+
+template<typename ElemT>
+template<typename LevelT>
+LevelSummary<ElemT>::LevelSummary(const LevelT& level, int64_t maxKeys) {
+  int64_t n = level.size();
+  int64_t shift = 0;
+  while ((n >> shift) > maxKeys) ++shift;
+  if (!shift) return;
+  if constexpr (std::is_integral_v<ElemT>) {
+    first = level[0];
+    dense = true;
+    for (int64_t i = 1; i < n && dense; ++i) dense = level[i] == static_cast<ElemT>(first + i);
+    if (dense) return;
+  }
+  std::vector<ElemT> layer;
+  layer.reserve((n >> shift) + 1);
+  for (int64_t i = 0; i < n; i += int64_t{1} << shift) layer.push_back(level[i]);
+  while (true) {
+    shifts.push_back(shift);
+    layers.push_back(std::move(layer));
+    auto& below = layers.back();
+    if (static_cast<int64_t>(below.size()) <= lineKeys) break;
+    layer = {};
+    for (size_t i = 0; i < below.size(); i += lineKeys) layer.push_back(below[i]);
+    shift += lineShift;
+  }
+}
+
+template<typename ElemT>
+int64_t LevelSummary<ElemT>::memoryUsage() const {
+  int64_t result = 0;
+  for (auto& layer : layers) result += layer.size() * sizeof(ElemT);
+  return result;
+}
+
+template<typename ElemT>
+template<typename NeedleT>
+std::pair<int64_t, int64_t> LevelSummary<ElemT>::narrow(int64_t begin, int64_t end, NeedleT needle) const {
+  if constexpr (std::is_integral_v<ElemT>) {
+    if (dense) {
+      // Element `i` is `first + i`, so there is nothing left to search
+      int64_t pos = needle <= first ? 0 : static_cast<int64_t>(needle - first);
+      pos = std::clamp(pos, begin, end);
+      return {pos, pos};
+    }
+  }
+  // The result of the search lies within `[lo, hi]`
+  int64_t lo = begin, hi = end;
+  for (int64_t layerIdx = layers.size() - 1; layerIdx >= 0; --layerIdx) {
+    auto& keys = layers[layerIdx];
+    int64_t shift = shifts[layerIdx];
+    // The keys sampled within `[lo, hi)`
+    int64_t keysBegin = (lo + (int64_t{1} << shift) - 1) >> shift;
+    int64_t keysEnd = (hi + (int64_t{1} << shift) - 1) >> shift;
+    if (keysBegin >= keysEnd) continue;
+    int64_t match = std::lower_bound(keys.begin() + keysBegin, keys.begin() + keysEnd, needle) - keys.begin();
+    if (match < keysEnd) hi = match << shift;
+    if (match > keysBegin) lo = ((match - 1) << shift) + 1;
+  }
+  return {lo, hi};
+}
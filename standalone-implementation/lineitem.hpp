@@ -0,0 +1,445 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "parallel.hpp"
+
+/// Loads the TPC-H `lineitem` table from text files with one row per line and
+/// a single-character column delimiter, e.g. the `|`-separated output of
+/// `dbgen` or a tab-separated export.
+///
+/// The file is memory-mapped and split into chunks at line boundaries. Each
+/// thread first counts the rows of its chunk and then parses them directly
+/// into their final positions of the columns. Delimiters are found
+/// 64 bytes at a time.
+///
+/// `save` writes the columns in a binary format, which `load` recognizes and
+/// copies instead of parsing, so benchmarks only have to parse a file once.
+namespace lineitem {
+  /// The columns in the order in which they appear in a row
+  enum class Column {
+    OrderKey, PartKey, SuppKey, LineNumber,
+    Quantity, ExtendedPrice, Discount, Tax,
+    ReturnFlag, LineStatus,
+    ShipDate, CommitDate, ReceiptDate,
+    ShipInstruct, ShipMode, Comment,
+  };
+  constexpr int64_t columnCnt = 16;
+
+  /// The parsed columns. Only requested columns are filled, all others stay
+  /// empty. The text columns `ShipInstruct`, `ShipMode` and `Comment` are
+  /// never stored. Dates are days since 1970-01-01.
+  struct Table {
+    int64_t rowCnt = 0;
+    std::vector<int64_t> orderKey, partKey, suppKey, lineNumber;
+    std::vector<double> quantity, extendedPrice, discount, tax;
+    std::vector<char> returnFlag, lineStatus;
+    std::vector<int32_t> shipDate, commitDate, receiptDate;
+  };
+
+  /// The columns which `Table` can hold
+  inline const std::initializer_list<Column> storedColumns = {
+    Column::OrderKey, Column::PartKey, Column::SuppKey, Column::LineNumber,
+    Column::Quantity, Column::ExtendedPrice, Column::Discount, Column::Tax,
+    Column::ReturnFlag, Column::LineStatus,
+    Column::ShipDate, Column::CommitDate, Column::ReceiptDate,
+  };
+
+  /// Below this size, a chunk isn't worth its own thread
+  constexpr int64_t minChunkBytes = 1 << 20;
+
+  /// Identifies the files written by `save`
+  constexpr char cacheMagic[8] = {'L', 'I', 'N', 'E', 'I', 'T', 'E', 'M'};
+  constexpr uint64_t cacheVersion = 1;
+
+  namespace detail {
+    /// Calls `f(column, values)` for all columns which `Table` can hold
+    template<typename TableT, typename F>
+    void forEachStoredColumn(TableT& table, F f) {
+      f(Column::OrderKey, table.orderKey);
+      f(Column::PartKey, table.partKey);
+      f(Column::SuppKey, table.suppKey);
+      f(Column::LineNumber, table.lineNumber);
+      f(Column::Quantity, table.quantity);
+      f(Column::ExtendedPrice, table.extendedPrice);
+      f(Column::Discount, table.discount);
+      f(Column::Tax, table.tax);
+      f(Column::ReturnFlag, table.returnFlag);
+      f(Column::LineStatus, table.lineStatus);
+      f(Column::ShipDate, table.shipDate);
+      f(Column::CommitDate, table.commitDate);
+      f(Column::ReceiptDate, table.receiptDate);
+    }
+
+    /// Start of the files written by `save`. It is followed by the columns,
+    /// each starting at a multiple of 64 bytes, in the byte order of the
+    /// machine which wrote the file.
+    struct CacheHeader {
+      char magic[8];
+      uint64_t version;
+      uint64_t rowCnt;
+      /// Where each column starts in the file, or 0 if it was not stored
+      uint64_t offsets[columnCnt];
+    };
+
+    constexpr uint64_t alignColumn(uint64_t offset) { return (offset + 63) / 64 * 64; }
+
+    /// A row has about 8 delimiters per 64 bytes, so most blocks contain
+    /// some and the loop over their bits rarely has to load the next block
+    constexpr int64_t blockSize = 64;
+
+    /// Bitmask of the bytes of `[block, block + 64)` which equal `a` or `b`.
+    /// Bytes at or behind `end` never match.
+    inline uint64_t matchBlock(const char* block, const char* end, char a, char b) {
+#ifdef __SSE2__
+      if (end - block >= blockSize) {
+        uint64_t result = 0;
+        for (int64_t i = 0; i < blockSize / 16; ++i) {
+          auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+          auto matches = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(a)), _mm_cmpeq_epi8(bytes, _mm_set1_epi8(b)));
+          result |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(matches))) << (16 * i);
+        }
+        return result;
+      }
+#endif
+      uint64_t result = 0;
+      int64_t n = std::min<int64_t>(blockSize, end - block);
+      for (int64_t i = 0; i < n; ++i) {
+        result |= static_cast<uint64_t>(block[i] == a || block[i] == b) << i;
+      }
+      return result;
+    }
+
+    /// Visits the column delimiters and line ends of `[begin, end)` in order
+    class DelimiterScanner {
+      const char* block;
+      const char* end;
+      char delimiter;
+      uint64_t mask;
+
+      public:
+      DelimiterScanner(const char* begin, const char* end, char delimiter)
+        : block(begin), end(end), delimiter(delimiter), mask(matchBlock(begin, end, delimiter, '\n')) {}
+
+      /// Returns the next delimiter or line end, or `end` if there is none
+      const char* next() {
+        while (!mask) {
+          block += blockSize;
+          if (block >= end) return end;
+          mask = matchBlock(block, end, delimiter, '\n');
+        }
+        auto result = block + __builtin_ctzll(mask);
+        mask &= mask - 1;
+        return result;
+      }
+    };
+
+    /// Number of line ends in `[begin, end)`
+    inline int64_t countLines(const char* begin, const char* end) {
+      int64_t result = 0;
+      for (auto block = begin; block < end; block += blockSize) {
+        result += __builtin_popcountll(matchBlock(block, end, '\n', '\n'));
+      }
+      return result;
+    }
+
+    inline bool parseInt(const char* begin, const char* end, int64_t& result) {
+      auto [ptr, ec] = std::from_chars(begin, end, result);
+      return ec == std::errc() && ptr == end && begin != end;
+    }
+
+    /// Parses decimals like `-123.45`. Up to 15 digits, the digits are exact
+    /// as an integer and dividing by an exact power of ten rounds correctly,
+    /// so the result is the same as with `from_chars`, which handles all
+    /// other cases.
+    inline bool parseDecimal(const char* begin, const char* end, double& result) {
+      static constexpr double powersOf10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+      auto pos = begin;
+      bool negative = pos != end && *pos == '-';
+      pos += negative;
+      int64_t mantissa = 0, digitCnt = 0, fractionDigits = 0;
+      bool seenDot = false;
+      for (; pos != end; ++pos) {
+        if (*pos >= '0' && *pos <= '9') {
+          mantissa = mantissa * 10 + (*pos - '0');
+          ++digitCnt;
+          fractionDigits += seenDot;
+        } else if (*pos == '.' && !seenDot) {
+          seenDot = true;
+        } else {
+          break;
+        }
+      }
+      if (pos == end && digitCnt > 0 && digitCnt <= 15) {
+        result = static_cast<double>(mantissa) / powersOf10[fractionDigits];
+        if (negative) result = -result;
+        return true;
+      }
+      auto [ptr, ec] = std::from_chars(begin, end, result);
+      return ec == std::errc() && ptr == end && begin != end;
+    }
+
+    /// Days from 1970-01-01 to the given date of the proleptic Gregorian calendar
+    inline int32_t daysFromCivil(int32_t year, int32_t month, int32_t day) {
+      // Count years from March, so that the leap day is the last day of a year
+      year -= month <= 2;
+      int32_t era = (year >= 0 ? year : year - 399) / 400;
+      int32_t yearOfEra = year - era * 400;
+      int32_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+      int32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+      return era * 146097 + dayOfEra - 719468;
+    }
+
+    /// Parses dates like `1996-03-13`
+    inline bool parseDate(const char* begin, const char* end, int32_t& result) {
+      if (end - begin != 10 || begin[4] != '-' || begin[7] != '-') return false;
+      auto digits = [&](int64_t from, int64_t to) {
+        int32_t value = 0;
+        for (int64_t i = from; i < to; ++i) {
+          uint32_t digit = begin[i] - '0';
+          // Marks the value as invalid, as no date part has that many digits
+          value = value * 10 + (digit < 10 ? digit : 100000);
+        }
+        return value;
+      };
+      int32_t year = digits(0, 4), month = digits(5, 7), day = digits(8, 10);
+      if (year > 9999 || month < 1 || month > 12 || day < 1 || day > 31) return false;
+      result = daysFromCivil(year, month, day);
+      return true;
+    }
+
+    [[noreturn]] inline void fail(int64_t row, const std::string& message) {
+      throw std::runtime_error("lineitem row " + std::to_string(row + 1) + ": " + message);
+    }
+
+    /// Parses the rows of `[begin, end)`, which consists of whole lines, into
+    /// the rows of `table` starting at `firstRow`
+    inline void parseRows(const char* begin, const char* end, char delimiter, const bool (&wanted)[columnCnt], Table& table, int64_t firstRow) {
+      DelimiterScanner scanner(begin, end, delimiter);
+      int64_t row = firstRow;
+      auto fieldBegin = begin;
+      while (fieldBegin < end) {
+        for (int64_t column = 0; column < columnCnt; ++column) {
+          auto fieldEnd = scanner.next();
+          auto isLineEnd = [&](const char* pos) { return pos == end || *pos == '\n'; };
+          auto nextBegin = fieldEnd + 1;
+          if (column == columnCnt - 1 && !isLineEnd(fieldEnd)) {
+            // `dbgen` ends every row with a delimiter, too
+            auto lineEnd = scanner.next();
+            if (lineEnd != fieldEnd + 1 || !isLineEnd(lineEnd)) fail(row, "more than " + std::to_string(columnCnt) + " columns");
+            nextBegin = lineEnd + 1;
+          } else if (isLineEnd(fieldEnd) != (column == columnCnt - 1)) {
+            fail(row, "only " + std::to_string(column + 1) + " columns");
+          }
+          if (wanted[column]) {
+            bool ok = true;
+            auto parseChar = [&](std::vector<char>& target) {
+              ok = fieldEnd - fieldBegin == 1;
+              target[row] = *fieldBegin;
+            };
+            switch (static_cast<Column>(column)) {
+              case Column::OrderKey: ok = parseInt(fieldBegin, fieldEnd, table.orderKey[row]); break;
+              case Column::PartKey: ok = parseInt(fieldBegin, fieldEnd, table.partKey[row]); break;
+              case Column::SuppKey: ok = parseInt(fieldBegin, fieldEnd, table.suppKey[row]); break;
+              case Column::LineNumber: ok = parseInt(fieldBegin, fieldEnd, table.lineNumber[row]); break;
+              case Column::Quantity: ok = parseDecimal(fieldBegin, fieldEnd, table.quantity[row]); break;
+              case Column::ExtendedPrice: ok = parseDecimal(fieldBegin, fieldEnd, table.extendedPrice[row]); break;
+              case Column::Discount: ok = parseDecimal(fieldBegin, fieldEnd, table.discount[row]); break;
+              case Column::Tax: ok = parseDecimal(fieldBegin, fieldEnd, table.tax[row]); break;
+              case Column::ReturnFlag: parseChar(table.returnFlag); break;
+              case Column::LineStatus: parseChar(table.lineStatus); break;
+              case Column::ShipDate: ok = parseDate(fieldBegin, fieldEnd, table.shipDate[row]); break;
+              case Column::CommitDate: ok = parseDate(fieldBegin, fieldEnd, table.commitDate[row]); break;
+              case Column::ReceiptDate: ok = parseDate(fieldBegin, fieldEnd, table.receiptDate[row]); break;
+              default: break;
+            }
+            if (!ok) fail(row, "invalid value in column " + std::to_string(column + 1));
+          }
+          fieldBegin = nextBegin;
+        }
+        ++row;
+      }
+    }
+
+    /// Read-only mapping of a whole file
+    class MappedFile {
+      const char* mapping = nullptr;
+      int64_t size = 0;
+
+      public:
+      explicit MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("unable to open " + path);
+        struct stat info;
+        if (fstat(fd, &info) < 0) {
+          close(fd);
+          throw std::runtime_error("unable to read " + path);
+        }
+        size = info.st_size;
+        if (size > 0) {
+          auto result = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+          if (result == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("unable to map " + path);
+          }
+          mapping = static_cast<const char*>(result);
+          // The chunks are read front to back
+          madvise(result, size, MADV_SEQUENTIAL);
+        }
+        close(fd);
+      }
+      MappedFile(const MappedFile&) = delete;
+      MappedFile& operator=(const MappedFile&) = delete;
+      ~MappedFile() {
+        if (mapping) munmap(const_cast<char*>(mapping), size);
+      }
+
+      std::string_view text() const { return {mapping, static_cast<size_t>(size)}; }
+    };
+  }
+
+  /// Parses the rows of `text` into the requested `columns`. Throws
+  /// `std::runtime_error` for rows which do not have 16 columns or whose
+  /// requested columns cannot be parsed.
+  inline Table parse(std::string_view text, std::initializer_list<Column> columns, char delimiter = '\t', int64_t chunkBytes = minChunkBytes) {
+    using namespace std;
+    bool wanted[columnCnt] = {};
+    for (auto column : columns) wanted[static_cast<int64_t>(column)] = true;
+    auto begin = text.data();
+    int64_t n = text.size();
+    // Move the chunk boundaries behind the next line end, so that no line is
+    // split between chunks
+    auto chunkCnt = parallel::chunkCount(n, chunkBytes);
+    vector<const char*> boundaries(chunkCnt + 1);
+    boundaries[0] = begin;
+    boundaries[chunkCnt] = begin + n;
+    for (int64_t i = 1; i < chunkCnt; ++i) {
+      auto nominal = max(begin + n * i / chunkCnt, boundaries[i - 1]);
+      auto lineEnd = static_cast<const char*>(memchr(nominal, '\n', begin + n - nominal));
+      boundaries[i] = lineEnd ? lineEnd + 1 : begin + n;
+    }
+    vector<int64_t> firstRows(chunkCnt + 1);
+    parallel::forEachTask(chunkCnt, [&](int64_t chunkIdx) {
+      firstRows[chunkIdx + 1] = detail::countLines(boundaries[chunkIdx], boundaries[chunkIdx + 1]);
+    });
+    // A last line without line end is a row, too
+    if (n > 0 && begin[n - 1] != '\n') ++firstRows[chunkCnt];
+    for (int64_t i = 0; i < chunkCnt; ++i) firstRows[i + 1] += firstRows[i];
+
+    Table table;
+    table.rowCnt = firstRows[chunkCnt];
+    detail::forEachStoredColumn(table, [&](Column column, auto& values) {
+      if (wanted[static_cast<int64_t>(column)]) values.resize(table.rowCnt);
+    });
+    // Exceptions must not escape the threads, so we rethrow the first one here
+    vector<exception_ptr> errors(chunkCnt);
+    parallel::forEachTask(chunkCnt, [&](int64_t chunkIdx) {
+      try {
+        detail::parseRows(boundaries[chunkIdx], boundaries[chunkIdx + 1], delimiter, wanted, table, firstRows[chunkIdx]);
+      } catch (...) {
+        errors[chunkIdx] = current_exception();
+      }
+    });
+    for (auto& error : errors) {
+      if (error) rethrow_exception(error);
+    }
+    return table;
+  }
+
+  /// Copies the requested `columns` out of `data`, the contents of a file
+  /// written by `save`
+  inline Table readCache(std::string_view data, std::initializer_list<Column> columns) {
+    using namespace std;
+    detail::CacheHeader header;
+    if (data.size() < sizeof(header)) throw runtime_error("truncated lineitem cache");
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion) {
+      throw runtime_error("unsupported lineitem cache version");
+    }
+    Table table;
+    table.rowCnt = header.rowCnt;
+    bool wanted[columnCnt] = {};
+    for (auto column : columns) wanted[static_cast<int64_t>(column)] = true;
+    detail::forEachStoredColumn(table, [&](Column column, auto& values) {
+      auto idx = static_cast<int64_t>(column);
+      if (!wanted[idx]) return;
+      auto offset = header.offsets[idx];
+      auto bytes = header.rowCnt * sizeof(values[0]);
+      if (!offset) throw runtime_error("column " + to_string(idx + 1) + " is not in the lineitem cache");
+      if (bytes && (offset > data.size() || bytes > data.size() - offset)) throw runtime_error("truncated lineitem cache");
+      values.resize(header.rowCnt);
+      // Copying in parallel also faults in the pages in parallel
+      parallel::forEachChunk(bytes, minChunkBytes, [&](int64_t, int64_t begin, int64_t end) {
+        memcpy(reinterpret_cast<char*>(values.data()) + begin, data.data() + offset + begin, end - begin);
+      });
+    });
+    return table;
+  }
+
+  /// Writes the columns of `table` which hold all its rows to `path`, in a
+  /// binary format which `load` copies instead of parsing. The file is first
+  /// written under a temporary name, so it is either complete or missing.
+  inline void save(const Table& table, const std::string& path) {
+    using namespace std;
+    detail::CacheHeader header{};
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.rowCnt = table.rowCnt;
+    uint64_t offset = detail::alignColumn(sizeof(header));
+    detail::forEachStoredColumn(table, [&](Column column, const auto& values) {
+      if (static_cast<int64_t>(values.size()) != table.rowCnt) return;
+      header.offsets[static_cast<int64_t>(column)] = offset;
+      offset = detail::alignColumn(offset + values.size() * sizeof(values[0]));
+    });
+    auto tmpPath = path + ".tmp";
+    {
+      auto file = unique_ptr<FILE, int (*)(FILE*)>(fopen(tmpPath.c_str(), "wb"), fclose);
+      if (!file) throw runtime_error("unable to create " + tmpPath);
+      bool ok = fwrite(&header, sizeof(header), 1, file.get()) == 1;
+      detail::forEachStoredColumn(table, [&](Column column, const auto& values) {
+        auto columnOffset = header.offsets[static_cast<int64_t>(column)];
+        if (!columnOffset) return;
+        ok = ok && fseek(file.get(), columnOffset, SEEK_SET) == 0;
+        ok = ok && fwrite(values.data(), sizeof(values[0]), values.size(), file.get()) == values.size();
+      });
+      ok = ok && fflush(file.get()) == 0;
+      if (!ok) throw runtime_error("unable to write " + tmpPath);
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) throw runtime_error("unable to write " + path);
+  }
+
+  /// The delimiter of the file at `path`: `|` for the `.tbl` files of `dbgen`,
+  /// tabs otherwise
+  inline char defaultDelimiter(const std::string& path) {
+    bool tbl = path.size() >= 4 && path.compare(path.size() - 4, 4, ".tbl") == 0;
+    return tbl ? '|' : '\t';
+  }
+
+  /// Maps the file at `path` and reads the requested `columns` using
+  /// `readCache` if `save` wrote it, or `parse` otherwise. Without a
+  /// `delimiter`, the `defaultDelimiter` is used.
+  inline Table load(const std::string& path, std::initializer_list<Column> columns, char delimiter = 0) {
+    detail::MappedFile file(path);
+    auto text = file.text();
+    if (text.size() >= sizeof(cacheMagic) && memcmp(text.data(), cacheMagic, sizeof(cacheMagic)) == 0) {
+      return readCache(text, columns);
+    }
+    return parse(text, columns, delimiter ? delimiter : defaultDelimiter(path));
+  }
+}
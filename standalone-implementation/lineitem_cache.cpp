@@ -0,0 +1,22 @@
+#include <exception>
+#include <iostream>
+#include "lineitem.hpp"
+
+/// Converts a TPC-H `lineitem` text file into the binary format of
+/// `lineitem::save`, which `lineitem::load` reads without parsing
+int main(int argc, char** argv) {
+  using namespace std;
+  if (argc != 3) {
+    cerr << "usage: " << argv[0] << " <lineitem file> <cache file>" << endl;
+    return 1;
+  }
+  try {
+    auto table = lineitem::load(argv[1], lineitem::storedColumns);
+    lineitem::save(table, argv[2]);
+    cout << "wrote " << table.rowCnt << " rows to " << argv[2] << endl;
+  } catch (const exception& e) {
+    cerr << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -1,4 +1,7 @@
 #include <array>
+#include <limits>
+#include <optional>
+#include <type_traits>
 #include <utility>
 #include <cstdint>
 
@@ -73,3 +76,140 @@ T updateLoserTree(std::array<T, cnt>& losers, int64_t updatedIdx, T newElement)
    } while (idx);
    return newWinner;
 }
+
+/// A tournament tree over `fanout` sorted inputs, which repeatedly yields the
+/// smallest head among all inputs and the input it belongs to. Equal keys are
+/// ordered by input, so merging with it is stable.
+///
+/// Unlike `makeLoserTree`, the tree is built once and `reset` for each merge.
+/// Keys and inputs are stored in separate arrays, so the keys of a path are
+/// packed densely. Node 0 holds the winner, node `i` the loser of the match
+/// between its children `2i` and `2i+1`. The leaves are the inputs. Exhausted
+/// inputs are marked by their index rather than by a reserved key, so all keys
+/// remain usable. The replay after each step is free of branches.
+template<typename KeyT, int64_t fanout>
+class LoserTree {
+   static_assert(fanout >= 2, "a tournament needs two inputs");
+   public:
+   using InputT = uint32_t;
+   /// Marks the input of a node whose inputs are all exhausted
+   static constexpr InputT exhausted = std::numeric_limits<InputT>::max();
+
+   private:
+   static constexpr int64_t leafCnt = ceilPowerOf2(fanout);
+   alignas(64) std::array<KeyT, leafCnt> keys;
+   alignas(64) std::array<InputT, leafCnt> inputs;
+
+   /// The key stored with exhausted inputs. Keys of live inputs may take the
+   /// same value, since the input breaks the tie in their favour.
+   static KeyT exhaustedKey() {
+      if constexpr (std::numeric_limits<KeyT>::has_infinity) {
+         return std::numeric_limits<KeyT>::infinity();
+      } else if constexpr (std::numeric_limits<KeyT>::is_specialized) {
+         return std::numeric_limits<KeyT>::max();
+      } else {
+         return KeyT{};
+      }
+   }
+
+   /// Does `(aKey, a)` win against `(bKey, b)`?
+   static bool wins(const KeyT& aKey, InputT a, const KeyT& bKey, InputT b) {
+      // Evaluated as a whole, since the outcome is not predictable
+      if constexpr (std::numeric_limits<KeyT>::is_specialized) {
+         return (aKey < bKey) | ((aKey == bKey) & (a < b));
+      } else {
+         return (a != exhausted) & ((b == exhausted) | (aKey < bKey) | (!(bKey < aKey) & (a < b)));
+      }
+   }
+
+   /// `cond ? a : b`. Compilers tend to turn the ternary into a branch, so
+   /// integers are blended with a mask instead.
+   template<typename T>
+   static T select(bool cond, T a, T b) {
+      if constexpr (std::is_integral_v<T>) {
+         using U = std::make_unsigned_t<T>;
+         U mask = -static_cast<U>(cond);
+         return static_cast<T>((static_cast<U>(a) & mask) | (static_cast<U>(b) & ~mask));
+      } else {
+         return cond ? a : b;
+      }
+   }
+
+   /// Replays the matches on the path from `input` to the root
+   void replay(InputT input, KeyT key, InputT player) {
+      for (uint64_t node = (input + leafCnt) / 2; node; node /= 2) {
+         KeyT loserKey = keys[node];
+         InputT loser = inputs[node];
+         bool swap = wins(loserKey, loser, key, player);
+         keys[node] = select(swap, key, loserKey);
+         inputs[node] = select(swap, player, loser);
+         key = select(swap, loserKey, key);
+         player = select(swap, loser, player);
+      }
+      keys[0] = key;
+      inputs[0] = player;
+   }
+
+   public:
+   /// Starts a new merge. `head(i)` returns the first key of input `i`, or
+   /// `std::nullopt` if it is empty.
+   template<typename H>
+   void reset(H head);
+
+   /// Are all inputs exhausted?
+   bool empty() const { return inputs[0] == exhausted; }
+   /// The smallest head
+   const KeyT& winnerKey() const { return keys[0]; }
+   /// The input of the smallest head
+   int64_t winner() const { return inputs[0]; }
+   /// The smallest head apart from the winner's, and its input, which is
+   /// `exhausted` if no other input has keys left. The winner's input keeps
+   /// winning as long as its keys are less than this key, or equal to it if
+   /// the winner's input is the smaller one.
+   std::pair<KeyT, InputT> runnerUp() const {
+      KeyT key = exhaustedKey();
+      InputT input = exhausted;
+      for (uint64_t node = (inputs[0] + leafCnt) / 2; node; node /= 2) {
+         bool better = wins(keys[node], inputs[node], key, input);
+         key = select(better, keys[node], key);
+         input = select(better, inputs[node], input);
+      }
+      return {key, input};
+   }
+   /// Replaces the smallest head with the next key of its input
+   void replaceWinner(KeyT key) { replay(inputs[0], key, inputs[0]); }
+   /// Removes the smallest head, whose input is now exhausted
+   void exhaustWinner() { replay(inputs[0], exhaustedKey(), exhausted); }
+};
+
+template<typename KeyT, int64_t fanout>
+template<typename H>
+void LoserTree<KeyT, fanout>::reset(H head) {
+   // The winners of the matches below each node. Nodes `leafCnt / 2` and
+   // above play between two inputs.
+   std::array<KeyT, leafCnt> winnerKeys;
+   std::array<InputT, leafCnt> winners;
+   for (int64_t node = leafCnt - 1; node; --node) {
+      KeyT childKeys[2];
+      InputT children[2];
+      for (int64_t c = 0; c < 2; ++c) {
+         int64_t child = 2 * node + c;
+         if (child < leafCnt) {
+            childKeys[c] = winnerKeys[child];
+            children[c] = winners[child];
+         } else {
+            std::optional<KeyT> key;
+            if (child - leafCnt < fanout) key = head(child - leafCnt);
+            childKeys[c] = key ? *key : exhaustedKey();
+            children[c] = key ? static_cast<InputT>(child - leafCnt) : exhausted;
+         }
+      }
+      int64_t w = !wins(childKeys[0], children[0], childKeys[1], children[1]);
+      winnerKeys[node] = childKeys[w];
+      winners[node] = children[w];
+      keys[node] = childKeys[1 - w];
+      inputs[node] = children[1 - w];
+   }
+   keys[0] = winnerKeys[1];
+   inputs[0] = winners[1];
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// How the memory of large tree structures is backed and placed.
+///
+/// Random queries on trees much larger than the TLB reach spend much of their
+/// time on page walks, and on multi-socket machines the node which first
+/// touched a level decides how expensive all later accesses to it are. The
+/// policy is process-wide, like the thread count in `parallel`, so it also
+/// applies to the trees built inside e.g. `mergesortRank`.
+namespace memorypolicy {
+  enum class HugePages {
+    /// Regular pages
+    None,
+    /// Ask for transparent huge pages using `madvise`
+    Transparent,
+    /// Map huge pages from the reserved pool (`MAP_HUGETLB`). Only possible for
+    /// memory we map ourselves; other memory falls back to transparent huge pages
+    Explicit,
+  };
+  enum class Placement {
+    /// Pages end up on the node of the thread which first touches them
+    FirstTouch,
+    /// Pages are spread round-robin over all nodes
+    Interleave,
+    /// Pages are placed on the node of the allocating thread
+    Local,
+  };
+  struct Policy {
+    HugePages hugePages = HugePages::None;
+    Placement placement = Placement::FirstTouch;
+    /// Fault in all pages right away instead of on first access
+    bool prefault = false;
+  };
+
+  /// Below this size, allocations are left to the default allocator
+  constexpr int64_t minPolicyBytes = 1 << 20;
+  /// We assume 2 MiB huge pages, the default on x86-64
+  constexpr int64_t hugePageSize = 2 << 20;
+
+  namespace detail {
+    inline Policy& currentPolicy() {
+      static Policy policy;
+      return policy;
+    }
+    // Not all C libraries define these yet
+    constexpr int madvPopulateWrite = 23;
+    constexpr int mpolInterleave = 3;
+    constexpr int mpolLocal = 4;
+    constexpr unsigned mpolMfMove = 1 << 1;
+
+    inline int64_t pageSize() {
+      static int64_t size = sysconf(_SC_PAGESIZE);
+      return size;
+    }
+    inline int64_t mappingSize(int64_t bytes) {
+      return (bytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+    }
+  }
+
+  /// The policy used for new allocations
+  inline const Policy& current() { return detail::currentPolicy(); }
+  /// Changes the policy for subsequent allocations
+  inline void set(const Policy& policy) { detail::currentPolicy() = policy; }
+
+  /// Parses a comma-separated list of `thp`, `hugetlb`, `interleave`, `local`
+  /// and `prefault`. `default` or an empty string select the default policy.
+  /// Returns false for unknown options.
+  inline bool parse(const std::string& spec, Policy& policy) {
+    policy = {};
+    size_t begin = 0;
+    while (begin < spec.size()) {
+      auto end = spec.find(',', begin);
+      if (end == std::string::npos) end = spec.size();
+      auto option = spec.substr(begin, end - begin);
+      if (option == "thp") {
+        policy.hugePages = HugePages::Transparent;
+      } else if (option == "hugetlb") {
+        policy.hugePages = HugePages::Explicit;
+      } else if (option == "interleave") {
+        policy.placement = Placement::Interleave;
+      } else if (option == "local") {
+        policy.placement = Placement::Local;
+      } else if (option == "prefault") {
+        policy.prefault = true;
+      } else if (option != "default") {
+        return false;
+      }
+      begin = end + 1;
+    }
+    return true;
+  }
+
+  /// Applies the current policy to the pages of `[data, data + bytes)`.
+  /// Only affects whole pages within the range. Pages which were already
+  /// touched are migrated to the requested nodes, but only pages faulted in
+  /// afterwards become huge pages. All requests are best-effort: kernels
+  /// without NUMA or huge page support simply ignore them.
+  inline void apply(const void* data, int64_t bytes) {
+    auto& policy = current();
+    if (bytes < minPolicyBytes) return;
+    auto pageSize = detail::pageSize();
+    auto begin = (reinterpret_cast<uintptr_t>(data) + pageSize - 1) / pageSize * pageSize;
+    auto end = (reinterpret_cast<uintptr_t>(data) + bytes) / pageSize * pageSize;
+    if (begin >= end) return;
+    auto pages = reinterpret_cast<void*>(begin);
+    auto length = end - begin;
+    if (policy.hugePages != HugePages::None) madvise(pages, length, MADV_HUGEPAGE);
+    if (policy.placement != Placement::FirstTouch) {
+      // All nodes, restricted by the kernel to the ones we may use
+      unsigned long nodeMask = ~0ul;
+      if (policy.placement == Placement::Interleave) {
+        syscall(SYS_mbind, pages, length, detail::mpolInterleave, &nodeMask, sizeof(nodeMask) * 8, detail::mpolMfMove);
+      } else {
+        syscall(SYS_mbind, pages, length, detail::mpolLocal, nullptr, 0, detail::mpolMfMove);
+      }
+    }
+    if (policy.prefault) madvise(pages, length, detail::madvPopulateWrite);
+  }
+
+  /// Allocates `bytes` of zeroed memory following the current policy.
+  /// Must be freed with `deallocate` and the same size.
+  inline void* allocate(int64_t bytes) {
+    if (bytes < minPolicyBytes) {
+      auto result = ::operator new(bytes);
+      std::memset(result, 0, bytes);
+      return result;
+    }
+    // Mappings are rounded to huge pages, so that `deallocate` can unmap
+    // them without knowing which kind of pages backs them
+    auto length = detail::mappingSize(bytes);
+    void* result = MAP_FAILED;
+    if (current().hugePages == HugePages::Explicit) {
+      result = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (result == MAP_FAILED) {
+      result = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (result == MAP_FAILED) throw std::bad_alloc();
+    apply(result, bytes);
+    return result;
+  }
+
+  /// Frees memory returned by `allocate(bytes)`
+  inline void deallocate(void* data, int64_t bytes) {
+    if (!data) return;
+    if (bytes < minPolicyBytes) {
+      ::operator delete(data);
+    } else {
+      munmap(data, detail::mappingSize(bytes));
+    }
+  }
+
+  template<typename T>
+  struct Deleter {
+    int64_t count = 0;
+    void operator()(T* data) const { deallocate(data, count * sizeof(T)); }
+  };
+  /// An array allocated according to the memory policy
+  template<typename T>
+  using UniqueArray = std::unique_ptr<T[], Deleter<T>>;
+
+  /// Allocates `count` zeroed elements according to the current policy
+  template<typename T>
+  UniqueArray<T> makeUniqueArray(int64_t count) {
+    static_assert(std::is_trivial_v<T>, "the elements are not constructed");
+    return UniqueArray<T>(static_cast<T*>(allocate(count * sizeof(T))), Deleter<T>{count});
+  }
+}
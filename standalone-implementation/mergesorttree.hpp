@@ -5,8 +5,17 @@
 #include <cstdint>
 #include <cmath>
 #include <cassert>
+#include <memory>
+#include <algorithm>
+#include <type_traits>
 #include "output.hpp"
 #include "losertree.hpp"
+#include "parallel.hpp"
+#include "packedlevel.hpp"
+#include "cascadingoffsets.hpp"
+#include "interleavedlevel.hpp"
+#include "memorypolicy.hpp"
+#include "levelsummary.hpp"
 
 #pragma once
 
@@ -24,19 +33,45 @@ constexpr bool fanoutsAlign(int64_t a, int64_t b) {
 }
 
 
-template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT = int64_t>
+/// Index of the first element in `[begin, end)` which is not less than `needle`.
+/// The range must be sorted.
+template<typename ElemT, typename NeedleT>
+int64_t lowerBound(const std::vector<ElemT>& level, int64_t begin, int64_t end, NeedleT needle) {
+  return std::lower_bound(level.data() + begin, level.data() + end, needle) - level.data();
+}
+
+
+/// `LevelT` is the storage of a level. Besides `std::vector<ElemT>`, the compressed
+/// `PackedLevel<ElemT>` can be used. Levels are only accessed through `size()`,
+/// `operator[]` and `lowerBound`.
+/// `InterleavedLevel<ElemT, fanout, cascading>` additionally takes over the
+/// cascading pointers of its level and stores them next to the elements.
+/// The width of the cascading pointers is chosen per level, independent of `IdxT`.
+/// The levels and pointers are allocated according to the current `memorypolicy`.
+/// Levels with long runs get a `LevelSummary` for the first search of a query.
+template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT = int64_t, typename LevelT = std::vector<ElemT>>
 struct MergeSortTree {
   // TODO: really needed? Shouldn't all combinations work now?
   static_assert(!cascading || fanoutsAlign(fanout, cascading), "`cascading` and `fanout` must align with each other");
 
   /// The tree data
-  std::vector<std::pair<std::vector<ElemT>, std::unique_ptr<IdxT[]>>> tree;
+  std::vector<std::pair<LevelT, CascadingOffsets>> tree;
 
   public:
   /// Constructor
   MergeSortTree() {}
   /// Constructor
   MergeSortTree(std::vector<ElemT>&& lowestLevel);
+  /// Constructor which carries a payload along with each element while merging.
+  /// The payload is not stored in the tree. Instead, `visit(level, runBegin, pos, elem, payload)`
+  /// is called for every element, in the order in which it is placed into the tree.
+  /// This allows to build per-level side structures without materializing a tree over the payload.
+  template<typename PayloadT, typename V>
+  MergeSortTree(std::vector<ElemT>&& lowestLevel, std::vector<PayloadT>&& payload, V visit);
+
+  /// Builds the tree over a permutation of `[0, n)` without merging.
+  /// Produces the same tree as the constructor.
+  static MergeSortTree fromPermutation(std::vector<ElemT>&& permutation);
 
   /// Dump
   void dump() const;
@@ -47,101 +82,363 @@ struct MergeSortTree {
 
 
   size_t selectNth(ElemT lower, ElemT upper, IdxT n) const;
-};
 
-// TODO: get rid of this again
-template<typename T>
-struct loser_traits {};
-template<>
-struct loser_traits<int64_t> {
-   static constexpr auto loser_value = std::numeric_limits<int64_t>::max();
-};
-template<typename... T>
-struct loser_traits<std::tuple<T...>> {
-   static constexpr auto loser_value = std::tuple<T...>{loser_traits<T>::loser_value...};
+  private:
+  /// Summaries of the levels with long runs, empty for all other levels
+  std::vector<LevelSummary<ElemT>> summaries;
+  /// Only levels with runs of at least this many elements are summarized
+  static constexpr int64_t minSummarizedRun = 16 * 1024;
+  /// Size of each summary. Small enough for the summaries of the upper levels to stay in L2
+  static constexpr int64_t summaryBytes = 64 * 1024;
+  /// Once an input wins this many times in a row, the merge gallops ahead in it
+  static constexpr int64_t minGallop = 8;
+
+  struct NoPayload {};
+  static constexpr bool interleaved = std::is_same_v<LevelT, InterleavedLevel<ElemT, fanout, cascading>>;
+  /// Turns the elements and cascading pointers of a level with runs of
+  /// `runLength` elements into its storage. Only moves from `level` if the
+  /// level is stored as a plain vector.
+  static std::pair<LevelT, CascadingOffsets> makeLevel(std::vector<ElemT>& level, CascadingOffsets&& offsets, int64_t runLength) {
+    if constexpr (std::is_same_v<LevelT, std::vector<ElemT>>) {
+      return {std::move(level), std::move(offsets)};
+    } else if constexpr (interleaved) {
+      return {LevelT(level, offsets, runLength), CascadingOffsets{}};
+    } else {
+      return {LevelT(level), std::move(offsets)};
+    }
+  }
+  /// Does `level` have cascading pointers?
+  bool hasCascadingOffsets(int64_t level) const {
+    if constexpr (interleaved) {
+      return tree[level].first.hasCascadingOffsets();
+    } else {
+      return static_cast<bool>(tree[level].second);
+    }
+  }
+  /// Position in level `level - 1` the cascading pointer `idx` of `level`
+  /// points to. `runBegin` is the begin of the run the pointer belongs to.
+  int64_t cascadingPosition(int64_t level, int64_t idx, int64_t runBegin) const {
+    if constexpr (interleaved) {
+      return tree[level].first.cascadingPosition(idx, runBegin);
+    } else {
+      return tree[level].second.position(idx, runBegin);
+    }
+  }
+  /// Index of the first element in `[begin, end)` of `level` which is not
+  /// less than `needle`. Uses the level's summary if it has one.
+  template<typename NeedleT>
+  int64_t summarizedLowerBound(int64_t level, int64_t begin, int64_t end, NeedleT needle) const {
+    if (static_cast<size_t>(level) < summaries.size() && !summaries[level].empty()) {
+      auto [lo, hi] = summaries[level].narrow(begin, end, needle);
+      return lowerBound(tree[level].first, lo, hi, needle);
+    }
+    return lowerBound(tree[level].first, begin, end, needle);
+  }
+  void buildSummaries();
+  template<typename PayloadT, typename V>
+  void build(std::vector<ElemT>&& lowestLevel, std::vector<PayloadT>&& payload, V visit);
 };
 
-template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT>
-MergeSortTree<fanout, cascading, ElemT, IdxT>::MergeSortTree(std::vector<ElemT>&& lowestLevel) {
+template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT, typename LevelT>
+MergeSortTree<fanout, cascading, ElemT, IdxT, LevelT>::MergeSortTree(std::vector<ElemT>&& lowestLevel) {
+  build(std::move(lowestLevel), std::vector<NoPayload>{}, [](auto&&...) {});
+}
+
+template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT, typename LevelT>
+template<typename PayloadT, typename V>
+MergeSortTree<fanout, cascading, ElemT, IdxT, LevelT>::MergeSortTree(std::vector<ElemT>&& lowestLevel, std::vector<PayloadT>&& payload, V visit) {
+  assert(lowestLevel.size() == payload.size());
+  build(std::move(lowestLevel), std::move(payload), visit);
+}
+
+template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT, typename LevelT>
+template<typename PayloadT, typename V>
+void MergeSortTree<fanout, cascading, ElemT, IdxT, LevelT>::build(std::vector<ElemT>&& lowestLevel, std::vector<PayloadT>&& payload, V visit) {
   using namespace std;
   constexpr bool debug = false;
+  constexpr bool hasPayload = !is_same_v<PayloadT, NoPayload>;
 
   int64_t len = lowestLevel.size();
-  tree.emplace_back(move(lowestLevel), nullptr);
+  if constexpr (hasPayload) {
+    for (int64_t i = 0; i < len; ++i) visit(int64_t{0}, i, i, lowestLevel[i], payload[i]);
+  }
+  // The uncompressed elements of the previous level. Compressed levels are
+  // decoded on access, so we keep a plain copy of the level we merge from.
+  vector<ElemT> uncompressed;
+  const vector<ElemT>* prevLevel;
+  auto storeLevel = [&](vector<ElemT>&& level, CascadingOffsets&& offsets, int64_t runLength) {
+    tree.push_back(makeLevel(level, move(offsets), runLength));
+    if constexpr (is_same_v<LevelT, vector<ElemT>>) {
+      prevLevel = &tree.back().first;
+    } else {
+      uncompressed = move(level);
+      prevLevel = &uncompressed;
+    }
+  };
+  // `prevLevel` may point into `tree`, which must not reallocate
+  int64_t levelCnt = 1;
+  for (int64_t w = 1; w < len; w *= fanout) ++levelCnt;
+  tree.reserve(levelCnt);
+  // The lowest level was already touched by the caller, so this can only migrate it
+  if constexpr (is_same_v<LevelT, vector<ElemT>>) memorypolicy::apply(lowestLevel.data(), len * sizeof(ElemT));
+  storeLevel(move(lowestLevel), {}, 1);
+  // The payload of the previous level, in the order of its elements.
+  // Only two levels of payload are alive at any time.
+  vector<PayloadT> prevPayload = move(payload);
+  vector<PayloadT> newPayload;
+  // Reused by all merges
+  auto loserTree = make_unique<LoserTree<ElemT, fanout>>();
   int64_t runLength = 1;
   while (runLength < len) {
     // merge previous level to construct new level
     auto newRunLength = runLength * fanout;
-    auto& prevLevel = tree.back();
     vector<ElemT> newLevel;
     newLevel.reserve(len);
+    if constexpr (is_same_v<LevelT, vector<ElemT>>) memorypolicy::apply(newLevel.data(), len * sizeof(ElemT));
+    if constexpr (hasPayload) {
+      newPayload.clear();
+      newPayload.reserve(len);
+    }
     int64_t newRunCnt = (len+newRunLength-1)/newRunLength;
-    unique_ptr<IdxT[]> cascadingOffsets;
+    CascadingOffsets cascadingOffsets;
     int64_t cascadingOffsetsInsertPos = 0;
     // TODO: This alloation here overallocates.
     // This is particularly bad for large fanouts and the reason why fanout=512, cascading<=8 runs out of memory in the evaluation.
-    if constexpr (cascading > 0) if (newRunLength > cascading) cascadingOffsets = make_unique<IdxT[]>(newRunCnt*(2 + newRunLength/cascading)*fanout);
+    if constexpr (cascading > 0) if (newRunLength > cascading) cascadingOffsets = CascadingOffsets(len, newRunLength, (2 + newRunLength/cascading)*fanout);
     if constexpr (debug) cout << "+++++ " << tree.size() << endl;
     // for each newly formed run
     for (int64_t newRunIdx = 0; newRunIdx < newRunCnt; ++newRunIdx) {
       if constexpr (debug) cout << "+++ " << newRunIdx << endl;
       // setup pointers and loser tree
-      constexpr pair<ElemT, int64_t> loserElem{loser_traits<ElemT>::loser_value, numeric_limits<int64_t>::max()};
-      array<pair<ElemT, int64_t>, fanout> initialElems;
       array<int64_t, fanout> readOffsets;
       array<int64_t, fanout> readLimits;
       for (int64_t i = 0; i < fanout; ++i) {
         int64_t ro = newRunIdx*newRunLength + i*runLength;
         readOffsets[i] = min(ro, len);
         readLimits[i] = min(ro + runLength, len);
-        if (readOffsets[i] != readLimits[i]) {
-          initialElems[i] = make_pair(prevLevel.first[ro], i);
-        } else {
-          initialElems[i] = loserElem;
-        }
       }
-      // merge until all input lists are empty
-      auto [loserTree, winner] = makeLoserTree(initialElems, loserElem);
-      while (winner != loserElem) {
-        if constexpr (debug) cout << winner << "; " << loserTree << endl;
-        // insert pointers for fractional cascading
+      // Inserts the pointers for fractional cascading if the next element
+      // starts a new group of `cascading` elements
+      auto insertCascadingOffsets = [&]() {
         if constexpr (cascading > 0) {
-          if (newRunLength > cascading) {
-            if ((newLevel.size() % cascading) == 0) {
-              for (int64_t i = 0; i < fanout; ++i) {
-                cascadingOffsets[cascadingOffsetsInsertPos++] = (readOffsets[i]);
-              }
+          if (newRunLength > cascading && (newLevel.size() % cascading) == 0) {
+            for (int64_t i = 0; i < fanout; ++i) {
+              cascadingOffsets.set(cascadingOffsetsInsertPos++, newRunIdx*newRunLength, readOffsets[i]);
             }
           }
         }
-        // insert smallest element
-        newLevel.emplace_back(winner.first);
-        // fill new element from corresponding input list
-        auto inputRunIdx = winner.second;
+      };
+      // Appends the next `cnt` elements of input `inputRunIdx`
+      auto append = [&](int64_t inputRunIdx, int64_t cnt) {
         auto& ro = readOffsets[inputRunIdx];
-        ro++;
-        if (ro < readLimits[inputRunIdx]) {
-          winner = updateLoserTree(loserTree, inputRunIdx, make_pair(prevLevel.first[ro], inputRunIdx));
+        while (cnt) {
+          int64_t chunk = cnt;
+          insertCascadingOffsets();
+          // Stop at the next group, which needs its own pointers
+          if constexpr (cascading > 0) {
+            if (newRunLength > cascading) chunk = min<int64_t>(chunk, cascading - newLevel.size() % cascading);
+          }
+          newLevel.insert(newLevel.end(), prevLevel->begin() + ro, prevLevel->begin() + ro + chunk);
+          if constexpr (hasPayload) {
+            for (int64_t pos = newLevel.size() - chunk; pos < static_cast<int64_t>(newLevel.size()); ++pos, ++ro) {
+              newPayload.push_back(move(prevPayload[ro]));
+              visit(static_cast<int64_t>(tree.size()), newRunIdx * newRunLength, pos, newLevel[pos], newPayload.back());
+            }
+          } else {
+            ro += chunk;
+          }
+          cnt -= chunk;
+        }
+      };
+      // If each input starts with an element no smaller than the last one of
+      // the input before, as in presorted data, the inputs are concatenated
+      bool ordered = true;
+      for (int64_t i = 1; i < fanout && ordered; ++i) {
+        if (readOffsets[i] < readLimits[i]) ordered = !((*prevLevel)[readOffsets[i]] < (*prevLevel)[readOffsets[i] - 1]);
+      }
+      if (ordered) {
+        for (int64_t i = 0; i < fanout; ++i) append(i, readLimits[i] - readOffsets[i]);
+      } else {
+        loserTree->reset([&](int64_t i) -> optional<ElemT> {
+          if (readOffsets[i] == readLimits[i]) return nullopt;
+          return (*prevLevel)[readOffsets[i]];
+        });
+      }
+      // Merge until all input lists are empty. Clustered data leads to long
+      // streaks of the same input. Once a streak is long enough, we look up
+      // the runner-up and gallop ahead in the input to the last element which
+      // still precedes it, like TimSort. The whole stretch is copied at once,
+      // with a single update of the loser tree.
+      int64_t streakInput = -1, streak = 0;
+      while (!ordered && !loserTree->empty()) {
+        auto inputRunIdx = loserTree->winner();
+        auto ro = readOffsets[inputRunIdx];
+        auto limit = readLimits[inputRunIdx];
+        // Masked, since a branch on random data would be mispredicted
+        streak = (streak & -static_cast<int64_t>(inputRunIdx == streakInput)) + 1;
+        streakInput = inputRunIdx;
+        if (streak < minGallop) {
+          insertCascadingOffsets();
+          // insert smallest element
+          newLevel.emplace_back(loserTree->winnerKey());
+          if constexpr (hasPayload) {
+            newPayload.push_back(move(prevPayload[ro]));
+            visit(static_cast<int64_t>(tree.size()), newRunIdx * newRunLength, static_cast<int64_t>(newLevel.size()) - 1, newLevel.back(), newPayload.back());
+          }
+          // fill new element from corresponding input list
+          readOffsets[inputRunIdx] = ++ro;
+          if (ro < limit) {
+            loserTree->replaceWinner((*prevLevel)[ro]);
+          } else {
+            loserTree->exhaustWinner();
+          }
+          continue;
+        }
+        // gallop to the first element behind the runner-up
+        int64_t cnt = limit - ro;
+        auto [runnerKey, runnerInput] = loserTree->runnerUp();
+        if (runnerInput != loserTree->exhausted) {
+          // Ties are won by the smaller input
+          bool winsTies = inputRunIdx < runnerInput;
+          auto precedes = [&](const ElemT& e) { return winsTies ? !(runnerKey < e) : e < runnerKey; };
+          // The head precedes, so we only search behind it
+          int64_t step = 1;
+          while (ro + step < limit && precedes((*prevLevel)[ro + step])) step *= 2;
+          auto searchBegin = prevLevel->begin() + ro + step / 2 + 1;
+          auto searchEnd = prevLevel->begin() + min(ro + step, limit);
+          cnt = partition_point(searchBegin, searchEnd, precedes) - (prevLevel->begin() + ro);
+        }
+        append(inputRunIdx, cnt);
+        if (ro + cnt < limit) {
+          loserTree->replaceWinner((*prevLevel)[ro + cnt]);
         } else {
-          winner = updateLoserTree(loserTree, inputRunIdx, loserElem);
+          loserTree->exhaustWinner();
         }
       }
       if constexpr (cascading > 0) if (newRunLength > cascading) {
         // We need two "terminator entries" for this run
         for (int64_t j = 0; j < 2; ++j) {
           for (int64_t i = 0; i < fanout; ++i) {
-             cascadingOffsets[cascadingOffsetsInsertPos++] = (readOffsets[i]);
+             cascadingOffsets.set(cascadingOffsetsInsertPos++, newRunIdx*newRunLength, readOffsets[i]);
           }
         }
       }
     }
-    tree.emplace_back(move(newLevel), move(cascadingOffsets));
+    storeLevel(move(newLevel), move(cascadingOffsets), newRunLength);
+    if constexpr (hasPayload) prevPayload.swap(newPayload);
     runLength = newRunLength;
   }
+  buildSummaries();
+}
+
+template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT, typename LevelT>
+void MergeSortTree<fanout, cascading, ElemT, IdxT, LevelT>::buildSummaries() {
+  int64_t len = tree.empty() ? 0 : tree[0].first.size();
+  summaries.clear();
+  summaries.resize(tree.size());
+  int64_t runLength = 1;
+  for (size_t level = 0; level < tree.size(); ++level, runLength *= fanout) {
+    if (std::min(runLength, len) < minSummarizedRun) continue;
+    summaries[level] = LevelSummary<ElemT>(tree[level].first, summaryBytes / sizeof(ElemT));
+  }
+}
+
+template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT, typename LevelT>
+MergeSortTree<fanout, cascading, ElemT, IdxT, LevelT> MergeSortTree<fanout, cascading, ElemT, IdxT, LevelT>::fromPermutation(std::vector<ElemT>&& permutation) {
+  using namespace std;
+  static_assert(is_integral_v<ElemT>, "permutations consist of integers");
+  // Runs smaller than this are grouped into one task
+  constexpr int64_t minTaskSize = 64 * 1024;
+
+  // Each run of a level contains the values whose positions in `permutation` lie
+  // within the run, in ascending order. Thus, the top level is `[0, n)` and each
+  // level is a stable partitioning of the level above by the position bits.
+  // Hence, we build the tree top-down and carry along each value's position.
+  // Each partitioning step only reads the level above sequentially and writes
+  // `fanout` sequential streams per run, which is much cheaper than merging.
+  int64_t len = permutation.size();
+  int64_t levelCnt = 1;
+  int64_t topRunLength = 1;
+  while (topRunLength < len) {
+    topRunLength *= fanout;
+    ++levelCnt;
+  }
+  MergeSortTree result;
+  result.tree.resize(levelCnt);
+  // The values become the levels, so their pages are placed according to the
+  // memory policy before they are first touched
+  auto allocateLevel = [&](vector<ElemT>& level) {
+    level.reserve(len);
+    memorypolicy::apply(level.data(), len * sizeof(ElemT));
+    level.resize(len);
+  };
+  vector<ElemT> values, positions(len);
+  vector<ElemT> childValues, childPositions(len);
+  allocateLevel(values);
+  allocateLevel(childValues);
+  parallel::forEachChunk(len, minTaskSize, [&](int64_t, int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; ++i) {
+      values[i] = i;
+      positions[permutation[i]] = i;
+    }
+  });
+  int64_t runLength = topRunLength;
+  for (int64_t level = levelCnt - 1; level > 0; --level) {
+    int64_t childRunLength = runLength / fanout;
+    int64_t runCnt = (len + runLength - 1) / runLength;
+    CascadingOffsets cascadingOffsets;
+    if constexpr (cascading > 0) if (runLength > cascading) cascadingOffsets = CascadingOffsets(len, runLength, (2 + runLength/cascading)*fanout);
+    // Partition all runs of this level into their children
+    int64_t runsPerTask = max<int64_t>(1, minTaskSize / runLength);
+    parallel::forEachChunk(runCnt, runsPerTask, [&](int64_t, int64_t firstRun, int64_t lastRun) {
+      for (int64_t runIdx = firstRun; runIdx < lastRun; ++runIdx) {
+        int64_t runBegin = runIdx * runLength;
+        int64_t runEnd = min(runBegin + runLength, len);
+        array<int64_t, fanout> writeOffsets;
+        for (int64_t i = 0; i < fanout; ++i) {
+          writeOffsets[i] = min(runBegin + i * childRunLength, len);
+        }
+        int64_t cascadingOffsetsInsertPos = 0;
+        if constexpr (cascading > 0) cascadingOffsetsInsertPos = runIdx * (2 + runLength / cascading) * fanout;
+        for (int64_t j = runBegin; j < runEnd; ++j) {
+          // insert pointers for fractional cascading
+          if constexpr (cascading > 0) {
+            if (cascadingOffsets && ((j - runBegin) % cascading) == 0) {
+              for (int64_t i = 0; i < fanout; ++i) {
+                cascadingOffsets.set(cascadingOffsetsInsertPos++, runBegin, writeOffsets[i]);
+              }
+            }
+          }
+          int64_t childIdx = (positions[j] - runBegin) / childRunLength;
+          auto& wo = writeOffsets[childIdx];
+          childValues[wo] = values[j];
+          childPositions[wo] = positions[j];
+          ++wo;
+        }
+        if constexpr (cascading > 0) if (cascadingOffsets) {
+          // We need two "terminator entries" for this run
+          for (int64_t k = 0; k < 2; ++k) {
+            for (int64_t i = 0; i < fanout; ++i) {
+              cascadingOffsets.set(cascadingOffsetsInsertPos++, runBegin, writeOffsets[i]);
+            }
+          }
+        }
+      }
+    });
+    result.tree[level] = makeLevel(values, move(cascadingOffsets), runLength);
+    values.swap(childValues);
+    positions.swap(childPositions);
+    allocateLevel(childValues);
+    runLength = childRunLength;
+  }
+  // The lowest level is the permutation itself
+  result.tree[0] = makeLevel(permutation, {}, 1);
+  result.buildSummaries();
+  return result;
 }
 
-template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT>
-void MergeSortTree<fanout, cascading, ElemT, IdxT>::dump() const {
+template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT, typename LevelT>
+void MergeSortTree<fanout, cascading, ElemT, IdxT, LevelT>::dump() const {
   using namespace std;
   auto& out = cerr;
   const char* separator = "    ";
@@ -149,14 +446,16 @@ void MergeSortTree<fanout, cascading, ElemT, IdxT>::dump() const {
   int64_t levelWidth = 1;
   int64_t numberWidth = 0;
   for (auto& level : tree) {
-    for (auto& e : level.first) {
+    for (int64_t i = 0; i < static_cast<int64_t>(level.first.size()); ++i) {
+      auto e = level.first[i];
       if (e) {
          int64_t digits = ceil(log10(fabs(e))) + (e < 0);
          if (digits > numberWidth) numberWidth = digits;
       }
     }
   }
-  for (auto& level : tree) {
+  for (int64_t levelNr = 0; levelNr < static_cast<int64_t>(tree.size()); ++levelNr) {
+    auto& level = tree[levelNr];
     // Print the elements themself
     {
       out << 'd';
@@ -167,15 +466,17 @@ void MergeSortTree<fanout, cascading, ElemT, IdxT>::dump() const {
       out << endl;
     }
     // Print the pointers
-    if (level.second) {
-      int64_t runCnt = (level.first.size()+levelWidth-1)/levelWidth;
-      int64_t cascadingIdcsCnt = runCnt*(2 + levelWidth/cascading)*fanout;
+    if (hasCascadingOffsets(levelNr)) {
+      // Up to the terminator entries of the last run
+      int64_t lastRun = (level.first.size()-1)/levelWidth;
+      int64_t cascadingIdcsCnt = ((level.first.size()-1)/cascading + 1 + 2*lastRun + 2)*fanout;
+      int64_t entriesPerRun = (2 + levelWidth/cascading)*fanout;
       for (int64_t childNr = 0; childNr < fanout; ++childNr) {
         out << " ";
         bool first = true;
         for (int64_t idx = 0; idx < cascadingIdcsCnt; idx += fanout) {
           out << ((idx && ((idx/fanout) % (levelWidth/cascading + 2) == 0)) ? groupSeparator : separator);
-          out << setw(numberWidth) << level.second[idx + childNr];
+          out << setw(numberWidth) << cascadingPosition(levelNr, idx + childNr, idx / entriesPerRun * levelWidth);
           first = false;
         }
         out << endl;
@@ -197,9 +498,9 @@ constexpr int64_t lowestCascadingLevel(int64_t fanout, int64_t cascading) {
 }
 
 
-template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT>
+template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT, typename LevelT>
 template<typename L>
-void MergeSortTree<fanout, cascading, ElemT, IdxT>::aggregateLowerBound(const int64_t lower, const int64_t upper, const int64_t needle, L aggregate) const {
+void MergeSortTree<fanout, cascading, ElemT, IdxT, LevelT>::aggregateLowerBound(const int64_t lower, const int64_t upper, const int64_t needle, L aggregate) const {
   constexpr bool debug = false;
   using std::cerr;
   using std::endl;
@@ -233,14 +534,17 @@ void MergeSortTree<fanout, cascading, ElemT, IdxT>::aggregateLowerBound(const in
   if constexpr (cascading != 0) if (level > lowestCascadingLevel(fanout, cascading))  {
     int64_t lowerCascadingIdx;
     int64_t upperCascadingIdx;
+    // The begin of the runs the cascading idcs belong to
+    int64_t lowerRunBegin;
+    int64_t upperRunBegin;
     // Find the initial cascading idcs
     {
       int64_t entryBegin = lowerRunIdx * levelWidth;
       int64_t entryEnd = std::min(entryBegin + levelWidth, static_cast<int64_t>(tree[0].first.size()));
-      auto* levelData = tree[level].first.data();
-      int64_t entryIdx = std::lower_bound(levelData + entryBegin, levelData + entryEnd, needle) - levelData;
+      int64_t entryIdx = summarizedLowerBound(level, entryBegin, entryEnd, needle);
       if constexpr (debug) cerr << "initial entry idx " << entryIdx << endl;
       lowerCascadingIdx = upperCascadingIdx = (entryIdx / cascading + 2 * (entryBegin / levelWidth)) * fanout;
+      lowerRunBegin = upperRunBegin = entryBegin;
       if constexpr (debug) cerr << "cascading Idx " << upperCascadingIdx << endl;
       // We have to sligthly shift the initial cascading idcs because at the top level we won't be exactly on a boundary
       int64_t correction = (prevUpperRunIdx - upperRunIdx * fanout);
@@ -254,8 +558,7 @@ void MergeSortTree<fanout, cascading, ElemT, IdxT>::aggregateLowerBound(const in
     do {
       --level;
       levelWidth /= fanout;
-      auto* levelData = tree[level].first.data();
-      auto& cascadingIdcs = tree[level+1].second;
+      auto& levelData = tree[level].first;
       if constexpr (debug) cerr << "level " << level << endl;
       if constexpr (debug) cerr << " currLower " << currLower << " currUpper " << currUpper << endl;
       if constexpr (debug) cerr << " cascading " << lowerCascadingIdx << " " << upperCascadingIdx << endl;
@@ -266,14 +569,14 @@ void MergeSortTree<fanout, cascading, ElemT, IdxT>::aggregateLowerBound(const in
         lowerCascadingIdx += fanout - 1;
         while (currLower - lower >= levelWidth) {
           if constexpr (debug) cerr << "  currLower " << currLower << "\n";
-          if constexpr (debug) cerr << "   cascading idx " << lowerCascadingIdx << " " << cascadingIdcs[lowerCascadingIdx] << " " << cascadingIdcs[lowerCascadingIdx + fanout] << endl;
+          if constexpr (debug) cerr << "   cascading idx " << lowerCascadingIdx << " " << cascadingPosition(level + 1, lowerCascadingIdx, lowerRunBegin) << " " << cascadingPosition(level + 1, lowerCascadingIdx + fanout, lowerRunBegin) << endl;
           // Search based on cascading info from previous level
-          const auto* searchBegin = levelData + cascadingIdcs[lowerCascadingIdx];
-          const auto* searchEnd = levelData + cascadingIdcs[lowerCascadingIdx + fanout];
-          if constexpr (debug) cerr << "   search " << (searchBegin - levelData) << " - " << (searchEnd - levelData) << endl;
-          const auto* it = std::lower_bound(searchBegin, searchEnd, needle);
+          int64_t searchBegin = cascadingPosition(level + 1, lowerCascadingIdx, lowerRunBegin);
+          int64_t searchEnd = cascadingPosition(level + 1, lowerCascadingIdx + fanout, lowerRunBegin);
+          if constexpr (debug) cerr << "   search " << searchBegin << " - " << searchEnd << endl;
+          int64_t it = lowerBound(levelData, searchBegin, searchEnd, needle);
           // Compute runBegin and pass it to our callback
-          const auto* runBegin = levelData + currLower - levelWidth;
+          int64_t runBegin = currLower - levelWidth;
           aggregate(level, runBegin, it);
           // Update state for next round
           currLower -= levelWidth;
@@ -281,12 +584,13 @@ void MergeSortTree<fanout, cascading, ElemT, IdxT>::aggregateLowerBound(const in
         }
         // Handle the partial last run to find the cascading entry point for the next level
         if (currLower != lower) {
-          const auto* searchBegin = levelData + cascadingIdcs[lowerCascadingIdx];
-          const auto* searchEnd = levelData + cascadingIdcs[lowerCascadingIdx + fanout];
-          if constexpr (debug) cerr << "   search cascade " << (searchBegin - levelData) << " - " << (searchEnd - levelData) << endl;
-          auto idx = std::lower_bound(searchBegin, searchEnd, needle) - levelData;
-          if constexpr (debug) cerr << "   cascade " << (searchBegin - levelData) << " - " << (searchEnd - levelData) << " -> " << idx << endl;
+          int64_t searchBegin = cascadingPosition(level + 1, lowerCascadingIdx, lowerRunBegin);
+          int64_t searchEnd = cascadingPosition(level + 1, lowerCascadingIdx + fanout, lowerRunBegin);
+          if constexpr (debug) cerr << "   search cascade " << searchBegin << " - " << searchEnd << endl;
+          auto idx = lowerBound(levelData, searchBegin, searchEnd, needle);
+          if constexpr (debug) cerr << "   cascade " << searchBegin << " - " << searchEnd << " -> " << idx << endl;
           lowerCascadingIdx = (idx / cascading + 2 * (lower / levelWidth)) * fanout;
+          lowerRunBegin = currLower - levelWidth;
         }
       }
       // Right side of tree
@@ -296,12 +600,12 @@ void MergeSortTree<fanout, cascading, ElemT, IdxT>::aggregateLowerBound(const in
         while (upper - currUpper >= levelWidth) {
           if constexpr (debug) cerr << "  currUpper " << currUpper << "\n";
           // Search based on cascading info from previous level
-          const auto* searchBegin = levelData + cascadingIdcs[upperCascadingIdx];
-          const auto* searchEnd = levelData + cascadingIdcs[upperCascadingIdx + fanout];
-          if constexpr (debug) cerr << "   search " << (searchBegin - levelData) << " - " << (searchEnd - levelData) << endl;
-          const auto* it = std::lower_bound(searchBegin, searchEnd, needle);
+          int64_t searchBegin = cascadingPosition(level + 1, upperCascadingIdx, upperRunBegin);
+          int64_t searchEnd = cascadingPosition(level + 1, upperCascadingIdx + fanout, upperRunBegin);
+          if constexpr (debug) cerr << "   search " << searchBegin << " - " << searchEnd << endl;
+          int64_t it = lowerBound(levelData, searchBegin, searchEnd, needle);
           // Compute runBegin and pass it to our callback
-          const auto* runBegin = levelData + currUpper;
+          int64_t runBegin = currUpper;
           aggregate(level, runBegin, it);
           // Update state for next round
           currUpper += levelWidth;
@@ -309,11 +613,12 @@ void MergeSortTree<fanout, cascading, ElemT, IdxT>::aggregateLowerBound(const in
         }
         // Handle the partial last run to find the cascading entry point for the next level
         if (currUpper != upper) {
-          const auto* searchBegin = levelData + cascadingIdcs[upperCascadingIdx];
-          const auto* searchEnd = levelData + cascadingIdcs[upperCascadingIdx + fanout];
-          auto idx = std::lower_bound(searchBegin, searchEnd, needle) - levelData;
-          if constexpr (debug) cerr << "   cascade " << (searchBegin - levelData) << " - " << (searchEnd - levelData) << " -> " << idx << endl;
+          int64_t searchBegin = cascadingPosition(level + 1, upperCascadingIdx, upperRunBegin);
+          int64_t searchEnd = cascadingPosition(level + 1, upperCascadingIdx + fanout, upperRunBegin);
+          auto idx = lowerBound(levelData, searchBegin, searchEnd, needle);
+          if constexpr (debug) cerr << "   cascade " << searchBegin << " - " << searchEnd << " -> " << idx << endl;
           upperCascadingIdx = (idx / cascading + 2 * (upper / levelWidth)) * fanout;
+          upperRunBegin = currUpper;
         }
       }
     } while (level >= lowestCascadingLevel(fanout, cascading));
@@ -321,22 +626,21 @@ void MergeSortTree<fanout, cascading, ElemT, IdxT>::aggregateLowerBound(const in
   // Handle lower levels which won't have cascading info
   if (level) while (--level) {
     levelWidth /= fanout;
-    auto* levelData = tree[level].first.data();
     if constexpr (debug) cerr << "level " << level << endl;
     if constexpr (debug) cerr << " currLower " << currLower << " currUpper " << currUpper << endl;
     // Left side
     while (currLower - lower >= levelWidth) {
-      const auto* runEnd = levelData + currLower;
-      const auto* runBegin = runEnd - levelWidth;
-      const auto* it = std::lower_bound(runBegin, runEnd, needle);
+      int64_t runEnd = currLower;
+      int64_t runBegin = runEnd - levelWidth;
+      int64_t it = summarizedLowerBound(level, runBegin, runEnd, needle);
       aggregate(level, runBegin, it);
       currLower -= levelWidth;
     }
     // Right side
     while (upper - currUpper >= levelWidth) {
-      const auto* runBegin = levelData + currUpper;
-      const auto* runEnd = runBegin + levelWidth;
-      const auto* it = std::lower_bound(runBegin, runEnd, needle);
+      int64_t runBegin = currUpper;
+      int64_t runEnd = runBegin + levelWidth;
+      int64_t it = summarizedLowerBound(level, runBegin, runEnd, needle);
       aggregate(level, runBegin, it);
       currUpper += levelWidth;
     }
@@ -344,21 +648,21 @@ void MergeSortTree<fanout, cascading, ElemT, IdxT>::aggregateLowerBound(const in
   // The last layer
   if constexpr (debug) cerr << "last layer\n";
   {
-    auto* levelData = tree[0].first.data();
+    auto& levelData = tree[0].first;
     // Left side
     auto lowerIt = lower;
     while (lowerIt != currLower) {
       if constexpr (debug) cerr << " lower " << lowerIt << " " << currLower << endl;
-      const auto* runBegin = levelData + lowerIt;
-      const auto* it = runBegin + (*runBegin < needle);
+      int64_t runBegin = lowerIt;
+      int64_t it = runBegin + (levelData[runBegin] < needle);
       aggregate(level, runBegin, it);
       ++lowerIt;
     }
     // Right side
     while (currUpper != upper) {
       if constexpr (debug) cerr << " upper " << currUpper << endl;
-      const auto* runBegin = levelData + currUpper;
-      const auto* it = runBegin + (*runBegin < needle);
+      int64_t runBegin = currUpper;
+      int64_t it = runBegin + (levelData[runBegin] < needle);
       aggregate(level, runBegin, it);
       ++currUpper;
     }
@@ -366,19 +670,18 @@ void MergeSortTree<fanout, cascading, ElemT, IdxT>::aggregateLowerBound(const in
 }
 
 
-template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT>
-int64_t MergeSortTree<fanout, cascading, ElemT, IdxT>::aggregateLowerBoundSum(int64_t lower, int64_t upper, int64_t needle) const {
+template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT, typename LevelT>
+int64_t MergeSortTree<fanout, cascading, ElemT, IdxT, LevelT>::aggregateLowerBoundSum(int64_t lower, int64_t upper, int64_t needle) const {
   int64_t sum = 0;
-  aggregateLowerBound(lower, upper, needle, [&](int64_t level, const auto* begin, const auto* pos) {
+  aggregateLowerBound(lower, upper, needle, [&](int64_t /*level*/, int64_t begin, int64_t pos) {
     sum += pos - begin;
-    //std::cerr << "  ---AGG " << (begin - tree[level].first.data()) << " " << (pos - tree[level].first.data()) << std::endl;
   });
   //std::cerr << "AGG RES " << sum << std::endl;
   return sum;
 }
 
-template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT>
-size_t MergeSortTree<fanout, cascading, ElemT, IdxT>::selectNth(const ElemT lower, const ElemT upper, IdxT n) const {
+template<int64_t fanout, int64_t cascading, typename ElemT, typename IdxT, typename LevelT>
+size_t MergeSortTree<fanout, cascading, ElemT, IdxT, LevelT>::selectNth(const ElemT lower, const ElemT upper, IdxT n) const {
   assert(lower < upper);
   using namespace std;
   constexpr bool debug = false;
@@ -401,32 +704,33 @@ size_t MergeSortTree<fanout, cascading, ElemT, IdxT>::selectNth(const ElemT lowe
     int64_t upperCascadingIdx;
     // Find the initial cascading idcs
     {
-      auto& levelData = tree[levelNr+1].first;
-      int64_t lowerEntryIdx = std::lower_bound(levelData.begin(), levelData.end(), lower) - levelData.begin();
+      int64_t levelSize = tree[levelNr+1].first.size();
+      int64_t lowerEntryIdx = summarizedLowerBound(levelNr + 1, 0, levelSize, lower);
       lowerCascadingIdx = lowerEntryIdx / cascading * fanout;
-      int64_t upperEntryIdx = std::lower_bound(levelData.begin(), levelData.end(), upper) - levelData.begin();
+      int64_t upperEntryIdx = summarizedLowerBound(levelNr + 1, 0, levelSize, upper);
       upperCascadingIdx = upperEntryIdx / cascading * fanout;
     }
+    // The begin of the run the cascading idcs belong to
+    int64_t runBegin = 0;
     if constexpr (debug) cout << "cascading lvl " << levelNr << " idx " << traversalIdx << " n " << n << endl;
     // Handle all subsequent levels with cascading info attached
     // For the first layer, we already checked we have cascading indices available, otherwise
     // we wouldn't have even searched the entry points. Hence, we use a `do-while` instead of `while`
     do {
       if constexpr (debug) cout << "  lvl " << levelNr << " idx " << traversalIdx << endl;
-      auto* levelData = tree[levelNr].first.data();
-      auto& cascadingIdcs = tree[levelNr+1].second;
+      auto& levelData = tree[levelNr].first;
       // Go over all children until we found enough in range
       while (true) {
-         auto* lowerSearchBegin = levelData + cascadingIdcs[lowerCascadingIdx];
-         auto* lowerSearchEnd = levelData + cascadingIdcs[lowerCascadingIdx + fanout];
-         if constexpr (debug) cout << "    lower range " << (lowerSearchBegin - levelData) << "   "  << (lowerSearchEnd - levelData) << endl;
-         auto* lowerMatch = std::lower_bound(lowerSearchBegin, lowerSearchEnd, lower);
-         if constexpr (debug) cout << "    lower match " << (lowerMatch - levelData) << endl;
-         auto* upperSearchBegin = levelData + cascadingIdcs[upperCascadingIdx];
-         auto* upperSearchEnd = levelData + cascadingIdcs[upperCascadingIdx + fanout];
-         if constexpr (debug) cout << "    upper range " << (upperSearchBegin - levelData) << "   "  << (upperSearchEnd - levelData) << endl;
-         auto* upperMatch = std::lower_bound(upperSearchBegin, upperSearchEnd, upper);
-         if constexpr (debug) cout << "    upper match " << (upperMatch - levelData) << endl;
+         int64_t lowerSearchBegin = cascadingPosition(levelNr + 1, lowerCascadingIdx, runBegin);
+         int64_t lowerSearchEnd = cascadingPosition(levelNr + 1, lowerCascadingIdx + fanout, runBegin);
+         if constexpr (debug) cout << "    lower range " << lowerSearchBegin << "   "  << lowerSearchEnd << endl;
+         int64_t lowerMatch = lowerBound(levelData, lowerSearchBegin, lowerSearchEnd, lower);
+         if constexpr (debug) cout << "    lower match " << lowerMatch << endl;
+         int64_t upperSearchBegin = cascadingPosition(levelNr + 1, upperCascadingIdx, runBegin);
+         int64_t upperSearchEnd = cascadingPosition(levelNr + 1, upperCascadingIdx + fanout, runBegin);
+         if constexpr (debug) cout << "    upper range " << upperSearchBegin << "   "  << upperSearchEnd << endl;
+         int64_t upperMatch = lowerBound(levelData, upperSearchBegin, upperSearchEnd, upper);
+         if constexpr (debug) cout << "    upper match " << upperMatch << endl;
          int64_t cntMatches = upperMatch - lowerMatch;
          if constexpr (debug) cout << "    match cnt " << cntMatches << endl;
          if (cntMatches <= n) {
@@ -437,10 +741,9 @@ size_t MergeSortTree<fanout, cascading, ElemT, IdxT>::selectNth(const ElemT lowe
            if constexpr (debug) cout << "    new idx " << traversalIdx << " n " << n << endl;
          } else {
            // Move down to next level in tree
-           int64_t upperMatchIdx = upperMatch - levelData;
-           upperCascadingIdx = (upperMatchIdx / cascading + 2 * traversalIdx) * fanout;
-           int64_t lowerMatchIdx = lowerMatch - levelData;
-           lowerCascadingIdx = (lowerMatchIdx / cascading + 2 * traversalIdx) * fanout;
+           upperCascadingIdx = (upperMatch / cascading + 2 * traversalIdx) * fanout;
+           lowerCascadingIdx = (lowerMatch / cascading + 2 * traversalIdx) * fanout;
+           runBegin = traversalIdx * levelWidth;
            traversalIdx *= fanout;
            levelWidth /= fanout;
            --levelNr;
@@ -453,12 +756,12 @@ size_t MergeSortTree<fanout, cascading, ElemT, IdxT>::selectNth(const ElemT lowe
   if constexpr (debug) cout << "non-cascading lvl " << levelNr << " idx " << traversalIdx << " n " << n << endl;
   for (; levelNr; --levelNr) {
     auto& level = tree[levelNr].first;
-    auto rangeBegin = level.begin() + traversalIdx * levelWidth;
-    auto rangeEnd = rangeBegin + levelWidth;
+    int64_t rangeBegin = traversalIdx * levelWidth;
+    int64_t rangeEnd = rangeBegin + levelWidth;
    if constexpr (debug) cout << "  lvl " << levelNr << "  idx " << traversalIdx <<  endl;
-    while (rangeEnd < level.end()) {
-      auto matchesFirst = std::lower_bound(rangeBegin, rangeEnd, lower);
-      auto matchesLast = std::lower_bound(matchesFirst, rangeEnd, upper);
+    while (rangeEnd < static_cast<int64_t>(level.size())) {
+      auto matchesFirst = summarizedLowerBound(levelNr, rangeBegin, rangeEnd, lower);
+      auto matchesLast = summarizedLowerBound(levelNr, matchesFirst, rangeEnd, upper);
       auto cntMatches = matchesLast - matchesFirst;
       if constexpr (debug) cout << "    match cnt " << cntMatches << endl;
       if (cntMatches <= n) {
@@ -479,7 +782,7 @@ size_t MergeSortTree<fanout, cascading, ElemT, IdxT>::selectNth(const ElemT lowe
   // The last level
   if constexpr (debug) cout << "lastLevel idx " << traversalIdx << " n " << n << endl;
   {
-    auto* levelData = tree[0].first.data();
+    auto& levelData = tree[0].first;
     ++n;
     while (true) {
       auto v = levelData[traversalIdx];
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include "parallel.hpp"
+
+/// Order-preserving mapping of floating point numbers to `int64_t`.
+///
+/// The key of `x` are the IEEE bits of `x` as a double, with the magnitude bits
+/// of negative numbers flipped. Thus, the keys of two numbers compare like the
+/// numbers themselves and can be used with the integer code paths, e.g. the
+/// loser tree sentinels and the radix sort (after flipping the sign bit).
+/// -0 is mapped to the key of +0, and all NaNs to a single key which sorts
+/// after +infinity. Since -0 never occurs as a key, its key `~0` is free and
+/// denotes an empty result, in line with `emptyValue<int64_t>()`.
+namespace orderedkey {
+  constexpr int64_t magnitudeBits = std::numeric_limits<int64_t>::max();
+  constexpr int64_t emptyKey = ~int64_t{0};
+
+  template<typename T>
+  int64_t encode(T x) {
+    static_assert(std::is_floating_point_v<T>, "ordered keys are only defined for floating point numbers");
+    double d = x;
+    if (d == 0) d = 0;
+    if (d != d) d = std::numeric_limits<double>::quiet_NaN();
+    int64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    // For negative numbers, the magnitude bits grow while the number shrinks
+    return bits < 0 ? bits ^ magnitudeBits : bits;
+  }
+
+  template<typename T>
+  T decode(int64_t key) {
+    if (key == emptyKey) return std::numeric_limits<T>::quiet_NaN();
+    int64_t bits = key < 0 ? key ^ magnitudeBits : key;
+    double d;
+    std::memcpy(&d, &bits, sizeof(d));
+    return static_cast<T>(d);
+  }
+
+  /// Encodes all values of `inputData`
+  template<typename T>
+  std::vector<int64_t> encode(const std::vector<T>& inputData) {
+    std::vector<int64_t> keys(inputData.size());
+    parallel::forEachChunk(inputData.size(), 64 * 1024, [&](int64_t, int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; ++i) keys[i] = encode(inputData[i]);
+    });
+    return keys;
+  }
+
+  /// Decodes all `keys`
+  template<typename T>
+  std::vector<T> decode(const std::vector<int64_t>& keys) {
+    std::vector<T> result(keys.size());
+    parallel::forEachChunk(keys.size(), 64 * 1024, [&](int64_t, int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; ++i) result[i] = decode<T>(keys[i]);
+    });
+    return result;
+  }
+}
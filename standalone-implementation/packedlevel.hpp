@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+/// Compressed storage for one level of a `MergeSortTree`.
+///
+/// The elements are split into blocks of 64. Each block stores its minimum
+/// (frame of reference) and the differences to it using as many bits as the
+/// largest difference needs. A block of width `w` thus occupies exactly `w`
+/// 64-bit words. Within a sorted run, the values of a block are close to each
+/// other, e.g. the row indices in the upper levels of an index tree only need
+/// a few bits instead of 64.
+template<typename ElemT>
+struct PackedLevel {
+  static_assert(std::is_integral_v<ElemT>, "only integers can be packed");
+  static constexpr int64_t blockSize = 64;
+
+  private:
+  using Unsigned = std::make_unsigned_t<ElemT>;
+  struct Block {
+    /// The minimum of the block
+    ElemT reference;
+    /// Number of bits per element
+    uint8_t bitWidth;
+    /// Offset of the block's first word in `words`
+    int64_t wordOffset;
+  };
+  std::vector<Block> blocks;
+  std::vector<uint64_t> words;
+  int64_t count = 0;
+
+  static ElemT decodeDelta(ElemT reference, uint64_t delta) {
+    return static_cast<ElemT>(static_cast<Unsigned>(static_cast<Unsigned>(reference) + static_cast<Unsigned>(delta)));
+  }
+  static uint64_t widthMask(int64_t bitWidth) {
+    return bitWidth == 64 ? ~uint64_t{0} : (uint64_t{1} << bitWidth) - 1;
+  }
+
+  public:
+  /// Constructor
+  PackedLevel() {}
+  /// Constructor
+  explicit PackedLevel(const std::vector<ElemT>& values);
+
+  int64_t size() const { return count; }
+  /// Size of the compressed data in bytes
+  int64_t memoryUsage() const { return blocks.size() * sizeof(Block) + words.size() * sizeof(uint64_t); }
+
+  /// Returns the `i`th element
+  ElemT operator[](int64_t i) const {
+    auto& block = blocks[i / blockSize];
+    int64_t bitWidth = block.bitWidth;
+    if (!bitWidth) return block.reference;
+    int64_t bitPos = (i % blockSize) * bitWidth;
+    const uint64_t* blockWords = words.data() + block.wordOffset;
+    int64_t shift = bitPos % 64;
+    uint64_t delta = blockWords[bitPos / 64] >> shift;
+    if (shift + bitWidth > 64) delta |= blockWords[bitPos / 64 + 1] << (64 - shift);
+    return decodeDelta(block.reference, delta & widthMask(bitWidth));
+  }
+
+  /// Decodes the block `blockIdx` into `out`, which must have room for `blockSize` elements
+  void decodeBlock(int64_t blockIdx, ElemT* out) const;
+  /// Decodes all elements
+  std::vector<ElemT> unpack() const;
+};
+
+template<typename ElemT>
+PackedLevel<ElemT>::PackedLevel(const std::vector<ElemT>& values) : count(values.size()) {
+  int64_t blockCnt = (count + blockSize - 1) / blockSize;
+  blocks.reserve(blockCnt);
+  for (int64_t blockBegin = 0; blockBegin < count; blockBegin += blockSize) {
+    int64_t blockEnd = std::min(blockBegin + blockSize, count);
+    ElemT minValue = values[blockBegin];
+    ElemT maxValue = values[blockBegin];
+    for (int64_t i = blockBegin; i < blockEnd; ++i) {
+      minValue = std::min(minValue, values[i]);
+      maxValue = std::max(maxValue, values[i]);
+    }
+    // Compute the differences in unsigned arithmetic to avoid signed overflows
+    uint64_t maxDelta = static_cast<Unsigned>(static_cast<Unsigned>(maxValue) - static_cast<Unsigned>(minValue));
+    int64_t bitWidth = maxDelta ? 64 - __builtin_clzll(maxDelta) : 0;
+    blocks.push_back({minValue, static_cast<uint8_t>(bitWidth), static_cast<int64_t>(words.size())});
+    // Padding the last block to full size keeps `operator[]` free of bounds checks
+    if (!bitWidth) continue;
+    words.resize(words.size() + bitWidth);
+    uint64_t* blockWords = words.data() + blocks.back().wordOffset;
+    for (int64_t i = blockBegin; i < blockEnd; ++i) {
+      uint64_t delta = static_cast<Unsigned>(static_cast<Unsigned>(values[i]) - static_cast<Unsigned>(minValue));
+      int64_t bitPos = (i - blockBegin) * bitWidth;
+      int64_t shift = bitPos % 64;
+      blockWords[bitPos / 64] |= delta << shift;
+      if (shift + bitWidth > 64) blockWords[bitPos / 64 + 1] |= delta >> (64 - shift);
+    }
+  }
+}
+
+template<typename ElemT>
+void PackedLevel<ElemT>::decodeBlock(int64_t blockIdx, ElemT* out) const {
+  auto& block = blocks[blockIdx];
+  int64_t bitWidth = block.bitWidth;
+  const uint64_t* blockWords = words.data() + block.wordOffset;
+  auto mask = widthMask(bitWidth);
+  // Written without data-dependent branches, so that the compiler can vectorize it
+  for (int64_t i = 0; i < blockSize; ++i) {
+    int64_t bitPos = i * bitWidth;
+    int64_t shift = bitPos % 64;
+    uint64_t low = bitWidth ? blockWords[bitPos / 64] >> shift : 0;
+    // The shift by `64 - shift` would be undefined for `shift == 0`, so split it into two shifts
+    uint64_t high = (shift + bitWidth > 64) ? (blockWords[bitPos / 64 + 1] << 1) << (63 - shift) : 0;
+    out[i] = decodeDelta(block.reference, (low | high) & mask);
+  }
+}
+
+template<typename ElemT>
+std::vector<ElemT> PackedLevel<ElemT>::unpack() const {
+  std::vector<ElemT> result(blocks.size() * blockSize);
+  for (int64_t blockIdx = 0; blockIdx < static_cast<int64_t>(blocks.size()); ++blockIdx) {
+    decodeBlock(blockIdx, result.data() + blockIdx * blockSize);
+  }
+  result.resize(count);
+  return result;
+}
+
+/// Index of the first element in `[begin, end)` which is not less than `needle`.
+/// The range must be sorted.
+template<typename ElemT, typename NeedleT>
+int64_t lowerBound(const PackedLevel<ElemT>& level, int64_t begin, int64_t end, NeedleT needle) {
+  // Each probe only decodes a single element
+  while (begin < end) {
+    int64_t middle = begin + (end - begin) / 2;
+    if (level[middle] < needle) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  return begin;
+}
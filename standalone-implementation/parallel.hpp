@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+  namespace detail {
+    inline int64_t& threadCountSetting() {
+      static int64_t threadCount = 0;
+      return threadCount;
+    }
+  }
+
+  /// The number of threads used by the parallel algorithms
+  inline int64_t threadCount() {
+    auto setting = detail::threadCountSetting();
+    if (setting > 0) return setting;
+    return std::max<int64_t>(1, std::thread::hardware_concurrency());
+  }
+
+  /// Overrides the number of threads. 0 restores the default, i.e. one thread per core
+  inline void setThreadCount(int64_t threadCount) {
+    detail::threadCountSetting() = threadCount;
+  }
+
+  /// Overrides the number of threads until it goes out of scope, then restores
+  /// the previous setting
+  class ScopedThreadCount {
+    int64_t previous;
+
+    public:
+    explicit ScopedThreadCount(int64_t threadCount) : previous(detail::threadCountSetting()) {
+      setThreadCount(threadCount);
+    }
+    ~ScopedThreadCount() { setThreadCount(previous); }
+    ScopedThreadCount(const ScopedThreadCount&) = delete;
+    ScopedThreadCount& operator=(const ScopedThreadCount&) = delete;
+  };
+
+  /// Calls `f(taskIdx)` for all `taskIdx` in `[0, taskCnt)`, each on its own thread
+  template<typename F>
+  void forEachTask(int64_t taskCnt, F f) {
+    if (taskCnt <= 1) {
+      if (taskCnt == 1) f(0);
+      return;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(taskCnt - 1);
+    for (int64_t taskIdx = 1; taskIdx < taskCnt; ++taskIdx) {
+      threads.emplace_back([&f, taskIdx]() { f(taskIdx); });
+    }
+    f(0);
+    for (auto& t : threads) t.join();
+  }
+
+  /// Number of chunks `forEachChunk` splits `n` elements into
+  inline int64_t chunkCount(int64_t n, int64_t minChunkSize) {
+    return std::clamp<int64_t>(n / std::max<int64_t>(minChunkSize, 1), 1, threadCount());
+  }
+
+  /// Splits `[0, n)` into `chunkCount(n, minChunkSize)` contiguous chunks and
+  /// calls `f(chunkIdx, begin, end)` for all of them concurrently.
+  /// The chunk boundaries only depend on `n`, `minChunkSize` and the thread count,
+  /// so multiple passes over the same data see the same chunks.
+  template<typename F>
+  void forEachChunk(int64_t n, int64_t minChunkSize, F f) {
+    auto chunkCnt = chunkCount(n, minChunkSize);
+    forEachTask(chunkCnt, [&](int64_t chunkIdx) {
+      f(chunkIdx, n * chunkIdx / chunkCnt, n * (chunkIdx + 1) / chunkCnt);
+    });
+  }
+}
@@ -3,24 +3,102 @@
 #include <algorithm>
 #include <optional>
 #include <cassert>
+#include <type_traits>
+#include <limits>
 #include "mergesorttree.hpp"
+#include "dictionary.hpp"
+#include "orderedkey.hpp"
+#include "radixsort.hpp"
+#include "simdpartition.hpp"
+#include "framebounds.hpp"
+#include "countedbtree.hpp"
 #include "output.hpp"
 
 
+template<typename T, typename Comp = std::less<T>>
+T medianOf3(T a, T b, T c, Comp comp = {}) {
+  using namespace std;
+  return max(min(a,b,comp), min(max(a,b,comp),c,comp),comp);
+}
+
+
+/// Orders pointers by the values they point to
 template<typename T>
-T medianOf3(T a, T b, T c) {
+struct PointeeLess {
+  bool operator()(const T* a, const T* b) const { return *a < *b; }
+};
+
+
+template<typename IterT, typename Comp = std::less<std::decay_t<decltype(*std::declval<IterT>())>>>
+const auto selectNthValue(const IterT begin, const IterT end, size_t n, Comp comp = {});
+
+
+/// The median of the medians of groups of five, which lies between the 30th
+/// and the 70th percentile. Reorders the elements.
+template<typename IterT, typename Comp>
+auto medianOfMedians(IterT begin, IterT end, Comp comp) {
   using namespace std;
-  return max(min(a,b), min(max(a,b),c));
+  vector<decay_t<decltype(*begin)>> medians;
+  medians.reserve((end - begin + 4) / 5);
+  for (auto group = begin; group != end;) {
+    auto groupEnd = group + min<ptrdiff_t>(5, end - group);
+    sort(group, groupEnd, comp);
+    medians.push_back(*(group + (groupEnd - group) / 2));
+    group = groupEnd;
+  }
+  return selectNthValue(medians.begin(), medians.end(), medians.size() / 2, comp);
 }
 
 
+/// Reorders `[begin, end)` so that the `n`th element is at its sorted position,
+/// with no greater elements before and no smaller elements after it.
+///
+/// Integers, and pointers to integers compared with `PointeeLess`, are
+/// partitioned with the `simdpartition` kernels. Median-of-3 pivots are cheap,
+/// but adversarial inputs can make them take quadratic time. Once the rounds
+/// have partitioned eight times as many elements as the input holds, we switch
+/// to median-of-medians pivots, which guarantee linear time.
 template<typename IterT, typename Comp = std::less<std::decay_t<decltype(*std::declval<IterT>())>>>
 void partitionNth(IterT begin, IterT end, size_t n, Comp comp = {}) {
+  using namespace std;
   assert(n < (end - begin));
+  using ValueT = decay_t<decltype(*begin)>;
+  constexpr bool contiguous = is_pointer_v<IterT> || is_same_v<IterT, typename vector<ValueT>::iterator>;
+  constexpr bool valueKernels = contiguous && is_same_v<Comp, less<ValueT>> && simdpartition::hasKernels<ValueT>;
+  constexpr bool pointeeKernels = [] {
+    if constexpr (contiguous && is_pointer_v<ValueT>) {
+      using KeyT = remove_const_t<remove_pointer_t<ValueT>>;
+      return is_same_v<ValueT, const KeyT*> && is_same_v<Comp, PointeeLess<KeyT>> && simdpartition::hasKernels<KeyT>;
+    }
+    return false;
+  }();
+  // Splits `[begin, end)` into the elements less than, equal to and greater than `pivot`
+  auto partition3 = [&](const ValueT& pivot) -> pair<IterT, IterT> {
+    if constexpr (valueKernels || pointeeKernels) {
+      auto data = &*begin;
+      int64_t size = end - begin;
+      auto key = [&] {
+        if constexpr (pointeeKernels) return *pivot; else return pivot;
+      }();
+      int64_t lessCnt = simdpartition::partitionLess(data, size, key);
+      // Integers equal to the pivot are exactly the ones less than its successor
+      int64_t notGreaterCnt = size;
+      if (key != numeric_limits<decltype(key)>::max()) {
+        notGreaterCnt = lessCnt + simdpartition::partitionLess(data + lessCnt, size - lessCnt, key + 1);
+      }
+      return {begin + lessCnt, begin + notGreaterCnt};
+    } else {
+      auto middle1 = std::partition(begin, end, [pivot, &comp](auto& a) { return comp(a, pivot); });
+      auto middle2 = std::partition(middle1, end, [pivot, &comp](auto& a) { return !comp(pivot, a); });
+      return {middle1, middle2};
+    }
+  };
+  // Median-of-3 quickselect partitions about 3n elements on average
+  ptrdiff_t budget = 8 * (end - begin);
   while (begin != end) {
-    auto pivot = medianOf3(*begin, *(end-1), *(begin + (end-begin)/2));
-    auto middle1 = std::partition(begin, end, [pivot, &comp](auto& a) { return comp(a, pivot); });
-    auto middle2 = std::partition(middle1, end, [pivot, &comp](auto& a) { return !comp(pivot, a); });
+    budget -= end - begin;
+    ValueT pivot = budget < 0 ? medianOfMedians(begin, end, comp) : medianOf3(*begin, *(end-1), *(begin + (end-begin)/2), comp);
+    auto [middle1, middle2] = partition3(pivot);
     auto dist1 = middle1 - begin;
     auto dist2 = middle2 - begin;
     if (dist2 <= n) {
@@ -35,24 +113,31 @@ void partitionNth(IterT begin, IterT end, size_t n, Comp comp = {}) {
 }
 
 
-template<typename IterT, typename Comp = std::less<std::decay_t<decltype(*std::declval<IterT>())>>>
-const auto selectNthValue(const IterT begin, const IterT end, size_t n, Comp comp = {}) {
+template<typename IterT, typename Comp>
+const auto selectNthValue(const IterT begin, const IterT end, size_t n, Comp comp) {
   partitionNth(begin, end, n, comp);
   return *(begin + n);
 }
 
 
+/// Position of the `p`-th percentile within a frame of `size` rows. `p = 1`
+/// selects the largest value instead of the row past the frame.
+inline int64_t percentileIndex(int64_t size, double p) {
+  return std::min(static_cast<int64_t>(size * p), size - 1);
+}
+
+
 template<typename T, typename T1, typename T2>
-std::vector<T> naivePercentile(const std::vector<T>& inputData, T1 lowerBound, T2 upperBound, float p) {
+std::vector<T> naivePercentile(const std::vector<T>& inputData, T1 lowerBound, T2 upperBound, double p) {
   std::vector<T> result;
   result.reserve(inputData.size());
   for (size_t i = 0; i < inputData.size(); ++i) {
     auto lower = lowerBound(i, inputData.size());
     auto upper = upperBound(i, inputData.size());
     if (lower >= upper) { 
-      result.push_back(~T{0});
+      result.push_back(emptyValue<T>());
     } else {
-      auto n = static_cast<int64_t>((upper - lower) * p);
+      auto n = percentileIndex(upper - lower, p);
       std::vector<T> elementsCopy(inputData.begin() + lower, inputData.begin() + upper);
       result.push_back(selectNthValue(elementsCopy.begin(), elementsCopy.end(), n));
     }
@@ -62,7 +147,7 @@ std::vector<T> naivePercentile(const std::vector<T>& inputData, T1 lowerBound, T
 
 
 template<typename T, typename T1, typename T2>
-std::vector<T> incrementalPercentile(const std::vector<T>& inputData, T1 lowerBound, T2 upperBound, float p) {
+std::vector<T> incrementalPercentile(const std::vector<T>& inputData, T1 lowerBound, T2 upperBound, double p) {
   std::vector<T> result;
   result.reserve(inputData.size());
   std::vector<const T*> partialSorted;
@@ -72,7 +157,7 @@ std::vector<T> incrementalPercentile(const std::vector<T>& inputData, T1 lowerBo
     int64_t lower = lowerBound(i, inputData.size());
     int64_t upper = upperBound(i, inputData.size());
     if (lower >= upper) { 
-      result.push_back(~T{0});
+      result.push_back(emptyValue<T>());
     } else {
       // Update
       {
@@ -112,10 +197,10 @@ std::vector<T> incrementalPercentile(const std::vector<T>& inputData, T1 lowerBo
       }
       prevLower = lower;
       prevUpper = upper;
-      int64_t n = static_cast<int64_t>((upper - lower) * p);
+      int64_t n = percentileIndex(upper - lower, p);
       if (prevN != n) {
          prevN = n;
-         partitionNth(partialSorted.begin(), partialSorted.end(), n,  [](const T* a, const T* b) { return *a < *b; });
+         partitionNth(partialSorted.begin(), partialSorted.end(), n, PointeeLess<T>{});
       }
       result.push_back(*partialSorted[n]);
     }
@@ -124,37 +209,161 @@ std::vector<T> incrementalPercentile(const std::vector<T>& inputData, T1 lowerBo
 }
 
 
-template<int64_t fanout, int64_t cascading, typename T, typename T1, typename T2>
-std::vector<T> mergesortPercentile(const std::vector<T>& inputData, T1 lowerBound, T2 upperBound, float p) {
+/// Percentile which keeps the rows of the current frame in a `CountedBTree`.
+/// Each row entering or leaving the frame costs `O(log w)` for frames of `w`
+/// rows, however the frames move, and each result is a single selection.
+template<typename T, typename T1, typename T2>
+std::vector<T> countedBTreePercentile(const std::vector<T>& inputData, T1 lowerBound, T2 upperBound, double p) {
   using namespace std;
-  // Sort the whole input while keeping track of the indices
-  vector<pair<T, size_t>> sortWithIdx;
-  sortWithIdx.resize(inputData.size());
-  for (size_t i = 0; i < inputData.size(); ++i) {
-    sortWithIdx[i] = make_pair(inputData[i], i);
+  if constexpr (is_floating_point_v<T>) {
+    // Select on integer keys and only decode the results
+    auto keys = orderedkey::encode(inputData);
+    return orderedkey::decode<T>(countedBTreePercentile(keys, lowerBound, upperBound, p));
+  } else if constexpr (!is_arithmetic_v<T>) {
+    // Select on the dictionary codes and only decode the results
+    Dictionary<T> dictionary(inputData);
+    return dictionary.decode(countedBTreePercentile(dictionary.codes, lowerBound, upperBound, p));
+  } else {
+    vector<T> result;
+    result.reserve(inputData.size());
+    // Pairing each value with its row makes the keys unique, so we can erase
+    // exactly the rows which leave the frame
+    CountedBTree<pair<T, int64_t>> frame;
+    auto insertRows = [&](int64_t begin, int64_t end) {
+      for (int64_t j = begin; j < end; ++j) frame.insert({inputData[j], j});
+    };
+    auto eraseRows = [&](int64_t begin, int64_t end) {
+      for (int64_t j = begin; j < end; ++j) frame.erase({inputData[j], j});
+    };
+    int64_t prevLower = 0, prevUpper = 0;
+    for (size_t i = 0; i < inputData.size(); ++i) {
+      int64_t lower = lowerBound(i, inputData.size());
+      int64_t upper = upperBound(i, inputData.size());
+      if (lower >= upper) {
+        result.push_back(emptyValue<T>());
+        continue;
+      }
+      if (lower >= prevUpper || upper <= prevLower) {
+        // No overlap with the previous frame
+        frame.clear();
+        prevLower = prevUpper = lower;
+      }
+      eraseRows(prevLower, lower);
+      insertRows(lower, prevLower);
+      eraseRows(upper, prevUpper);
+      insertRows(prevUpper, upper);
+      prevLower = lower;
+      prevUpper = upper;
+      int64_t n = percentileIndex(upper - lower, p);
+      result.push_back(frame.select(n).first);
+    }
+    return result;
   }
-  sort(sortWithIdx.begin(), sortWithIdx.end());
-  vector<T> sorted;
-  vector<int64_t> indices;
-  sorted.resize(sortWithIdx.size());
-  indices.resize(sortWithIdx.size());
-  for (size_t i = 0; i < sortWithIdx.size(); ++i) {
-    sorted[i] = sortWithIdx[i].first;
-    indices[i] = sortWithIdx[i].second;
+}
+
+
+/// Percentile for frames which only grow, see `framebounds::growth`. The
+/// `n + 1` smallest values of the frame are kept in a max-heap and all others
+/// in a min-heap, so the result is the top of the max-heap. Since `n` never
+/// decreases while the frames grow, rebalancing moves at most two values per
+/// row on average.
+template<typename T, typename T1, typename T2>
+std::vector<T> growingFramePercentile(const std::vector<T>& inputData, framebounds::Growth growth, T1 lowerBound, T2 upperBound, double p) {
+  using namespace std;
+  int64_t rowCnt = inputData.size();
+  vector<T> result(rowCnt);
+  vector<T> lowHeap, highHeap;
+  lowHeap.reserve(rowCnt);
+  highHeap.reserve(rowCnt);
+  auto highComp = greater<T>{};
+  auto moveTop = [](vector<T>& from, auto fromComp, vector<T>& to, auto toComp) {
+    pop_heap(from.begin(), from.end(), fromComp);
+    to.push_back(move(from.back()));
+    from.pop_back();
+    push_heap(to.begin(), to.end(), toComp);
+  };
+  framebounds::visitGrowing(growth, lowerBound, upperBound, rowCnt,
+    [&](int64_t row) {
+      auto& v = inputData[row];
+      if (!lowHeap.empty() && v < lowHeap.front()) {
+        lowHeap.push_back(v);
+        push_heap(lowHeap.begin(), lowHeap.end());
+      } else {
+        highHeap.push_back(v);
+        push_heap(highHeap.begin(), highHeap.end(), highComp);
+      }
+    },
+    [&](int64_t row, int64_t lower, int64_t upper) {
+      if (lower >= upper) {
+        result[row] = emptyValue<T>();
+        return;
+      }
+      auto n = static_cast<size_t>(percentileIndex(upper - lower, p));
+      while (lowHeap.size() > n + 1) moveTop(lowHeap, less<T>{}, highHeap, highComp);
+      while (lowHeap.size() < n + 1) moveTop(highHeap, highComp, lowHeap, less<T>{});
+      result[row] = lowHeap.front();
+    });
+  return result;
+}
+
+
+/// Below this many rows, a chunk of tree queries isn't worth its own thread.
+/// Each query descends the whole tree, so chunks can be far smaller than for
+/// the linear passes of `radix`.
+constexpr int64_t minQueryChunkSize = 4 * 1024;
+
+/// `mergesortPercentile` for integers. `IdxT` is the type of the row indices stored in the tree
+template<int64_t fanout, int64_t cascading, typename IdxT, bool packed, bool prefixShortcut, typename T, typename T1, typename T2>
+std::vector<T> mergesortPercentileIntegral(const std::vector<T>& inputData, T1 lowerBound, T2 upperBound, double p) {
+  using namespace std;
+  if constexpr (prefixShortcut) {
+    auto growth = framebounds::growth(lowerBound, upperBound, inputData.size());
+    if (growth != framebounds::Growth::None) return growingFramePercentile(inputData, growth, lowerBound, upperBound, p);
   }
-  auto indexTree = MergeSortTree<fanout, cascading, int64_t>(move(indices));
+  // Sort the whole input while keeping track of the indices
+  vector<T> sorted;
+  vector<IdxT> indices;
+  radix::argsort(inputData, sorted, indices);
+  using LevelT = conditional_t<packed, PackedLevel<IdxT>, vector<IdxT>>;
+  auto indexTree = MergeSortTree<fanout, cascading, IdxT, IdxT, LevelT>::fromPermutation(move(indices));
 
-  vector<T> result;
-  result.reserve(inputData.size());
-  for (size_t i = 0; i < inputData.size(); ++i) {
-    int64_t lower = lowerBound(i, inputData.size());
-    int64_t upper = upperBound(i, inputData.size());
-    if (lower >= upper) { 
-      result.push_back(~T{0});
-    } else {
-      int64_t n = static_cast<int64_t>((upper - lower) * p);
-      result.push_back(sorted[indexTree.selectNth(lower, upper, n)]);
+  // The tree is immutable once built, so the rows are queried in parallel
+  int64_t rowCnt = inputData.size();
+  vector<T> result(rowCnt);
+  parallel::forEachChunk(rowCnt, minQueryChunkSize, [&](int64_t, int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; ++i) {
+      int64_t lower = lowerBound(i, rowCnt);
+      int64_t upper = upperBound(i, rowCnt);
+      if (lower >= upper) {
+        result[i] = emptyValue<T>();
+      } else {
+        result[i] = sorted[indexTree.selectNth(lower, upper, percentileIndex(upper - lower, p))];
+      }
     }
-  }
+  });
   return result;
 }
+
+
+/// With `packed`, the levels of the index tree are stored compressed. Unless
+/// `prefixShortcut` is disabled, frames which only grow are computed with
+/// `growingFramePercentile` instead of a tree. The rows are queried in
+/// parallel, so `lowerBound` and `upperBound` must be thread-safe.
+template<int64_t fanout, int64_t cascading, bool packed = false, bool prefixShortcut = true, typename T, typename T1, typename T2>
+std::vector<T> mergesortPercentile(const std::vector<T>& inputData, T1 lowerBound, T2 upperBound, double p) {
+  using namespace std;
+  if constexpr (is_floating_point_v<T>) {
+    // Sort and select on integer keys and only decode the results
+    auto keys = orderedkey::encode(inputData);
+    return orderedkey::decode<T>(mergesortPercentile<fanout, cascading, packed, prefixShortcut>(keys, lowerBound, upperBound, p));
+  } else if constexpr (!is_arithmetic_v<T>) {
+    // Select on the dictionary codes and only decode the results
+    Dictionary<T> dictionary(inputData);
+    return dictionary.decode(mergesortPercentile<fanout, cascading, packed, prefixShortcut>(dictionary.codes, lowerBound, upperBound, p));
+  } else if (inputData.size() <= static_cast<size_t>(numeric_limits<int32_t>::max())) {
+    // Narrow indices halve the size of the tree
+    return mergesortPercentileIntegral<fanout, cascading, int32_t, packed, prefixShortcut>(inputData, lowerBound, upperBound, p);
+  } else {
+    return mergesortPercentileIntegral<fanout, cascading, int64_t, packed, prefixShortcut>(inputData, lowerBound, upperBound, p);
+  }
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "parallel.hpp"
+
+namespace radix {
+  constexpr int64_t digitBits = 8;
+  constexpr int64_t bucketCnt = int64_t{1} << digitBits;
+  /// Below this size, a chunk isn't worth its own thread
+  constexpr int64_t minChunkSize = 64 * 1024;
+  /// Chunk size for callers which already run in parallel, such as the tasks
+  /// of another scheduler. The whole input forms one chunk, sorted on the
+  /// calling thread.
+  constexpr int64_t singleChunk = std::numeric_limits<int64_t>::max();
+  /// Number of elements buffered per bucket before they are written out
+  constexpr int64_t bufferSize = 16;
+
+  /// Maps an integer to an unsigned key with the same order
+  template<typename T>
+  std::make_unsigned_t<T> toKey(T x) {
+    using U = std::make_unsigned_t<T>;
+    if constexpr (std::is_signed_v<T>) {
+      return static_cast<U>(x) ^ (U{1} << (sizeof(U) * 8 - 1));
+    } else {
+      return x;
+    }
+  }
+
+  /// The inverse of `toKey`
+  template<typename T>
+  T fromKey(std::make_unsigned_t<T> key) {
+    using U = std::make_unsigned_t<T>;
+    if constexpr (std::is_signed_v<T>) {
+      return static_cast<T>(key ^ (U{1} << (sizeof(U) * 8 - 1)));
+    } else {
+      return key;
+    }
+  }
+
+  /// Returns a mask of the bits which differ between at least two keys
+  template<typename K>
+  K varyingBits(const std::vector<K>& keys, int64_t minChunk = minChunkSize) {
+    static_assert(std::is_unsigned_v<K>, "radix sort keys must be unsigned");
+    int64_t n = keys.size();
+    if (!n) return 0;
+    auto chunkCnt = parallel::chunkCount(n, minChunk);
+    std::vector<std::pair<K, K>> chunkBits(chunkCnt);
+    parallel::forEachChunk(n, minChunk, [&](int64_t chunkIdx, int64_t begin, int64_t end) {
+      K orBits = 0, andBits = ~K{0};
+      for (int64_t i = begin; i < end; ++i) {
+        orBits |= keys[i];
+        andBits &= keys[i];
+      }
+      chunkBits[chunkIdx] = {orBits, andBits};
+    });
+    K orBits = 0, andBits = ~K{0};
+    for (auto& [o, a] : chunkBits) {
+      orBits |= o;
+      andBits &= a;
+    }
+    return orBits ^ andBits;
+  }
+
+  /// Stable LSD radix sort of `keys`, carrying `values` along.
+  /// Digits which are the same for all keys are skipped.
+  /// Each pass is parallelized by letting every thread histogram and then
+  /// scatter its own contiguous chunk of the input. Chunks have at least
+  /// `minChunk` elements, see `singleChunk`.
+  template<typename K, typename V>
+  void sortPairs(std::vector<K>& keys, std::vector<V>& values, int64_t minChunk = minChunkSize) {
+    static_assert(std::is_unsigned_v<K>, "radix sort keys must be unsigned");
+    int64_t n = keys.size();
+    auto varying = varyingBits(keys, minChunk);
+    if (!varying) return;
+    auto chunkCnt = parallel::chunkCount(n, minChunk);
+    std::vector<std::array<int64_t, bucketCnt>> offsets(chunkCnt);
+    std::vector<K> keysTmp(n);
+    std::vector<V> valuesTmp(n);
+    for (int64_t shift = 0; shift < static_cast<int64_t>(sizeof(K) * 8); shift += digitBits) {
+      if (!((varying >> shift) & (bucketCnt - 1))) continue;
+      // Histogram per chunk
+      parallel::forEachChunk(n, minChunk, [&](int64_t chunkIdx, int64_t begin, int64_t end) {
+        auto& hist = offsets[chunkIdx];
+        hist.fill(0);
+        for (int64_t i = begin; i < end; ++i) {
+          ++hist[(keys[i] >> shift) & (bucketCnt - 1)];
+        }
+      });
+      // Turn the histograms into write offsets. All elements of a bucket from
+      // chunk `c` are placed before the ones from chunk `c+1` to keep the sort stable.
+      int64_t writePos = 0;
+      for (int64_t bucket = 0; bucket < bucketCnt; ++bucket) {
+        for (auto& chunkOffsets : offsets) {
+          auto cnt = chunkOffsets[bucket];
+          chunkOffsets[bucket] = writePos;
+          writePos += cnt;
+        }
+      }
+      // Scatter. Elements are first collected in small per-bucket buffers and
+      // then written out a cache line at a time. Writing each element directly
+      // would touch a different page for every bucket and thrash the TLB.
+      parallel::forEachChunk(n, minChunk, [&](int64_t chunkIdx, int64_t begin, int64_t end) {
+        auto& writeOffsets = offsets[chunkIdx];
+        auto buffers = std::make_unique<std::array<std::pair<K, V>, bufferSize>[]>(bucketCnt);
+        std::array<int64_t, bucketCnt> fill{};
+        auto flush = [&](int64_t bucket, int64_t cnt) {
+          auto pos = writeOffsets[bucket];
+          for (int64_t j = 0; j < cnt; ++j) {
+            keysTmp[pos + j] = buffers[bucket][j].first;
+            valuesTmp[pos + j] = std::move(buffers[bucket][j].second);
+          }
+          writeOffsets[bucket] += cnt;
+        };
+        for (int64_t i = begin; i < end; ++i) {
+          auto bucket = (keys[i] >> shift) & (bucketCnt - 1);
+          buffers[bucket][fill[bucket]] = {keys[i], std::move(values[i])};
+          if (++fill[bucket] == bufferSize) {
+            flush(bucket, bufferSize);
+            fill[bucket] = 0;
+          }
+        }
+        for (int64_t bucket = 0; bucket < bucketCnt; ++bucket) {
+          flush(bucket, fill[bucket]);
+        }
+      });
+      keys.swap(keysTmp);
+      values.swap(valuesTmp);
+    }
+  }
+
+  /// Largest number of distinct key values `countingSort` handles
+  constexpr int64_t maxCountingRange = int64_t{1} << 16;
+
+  /// Stable sort of the `n` elements at `input` by the integer `key(x)` into
+  /// `output`, if the keys span at most `maxCountingRange` values, e.g.
+  /// dates. Every thread histograms its own chunk over the whole key range
+  /// and then scatters it, so the sort takes two passes over the input
+  /// after finding the range. Returns false and leaves `output` untouched
+  /// for larger ranges.
+  template<typename T, typename KeyFn>
+  bool countingSort(const T* input, T* output, int64_t n, KeyFn key) {
+    using U = std::make_unsigned_t<decltype(key(*input))>;
+    if (!n) return true;
+    auto chunkCnt = parallel::chunkCount(n, minChunkSize);
+    std::vector<std::pair<U, U>> chunkRanges(chunkCnt);
+    parallel::forEachChunk(n, minChunkSize, [&](int64_t chunkIdx, int64_t begin, int64_t end) {
+      U lo = ~U{0}, hi = 0;
+      for (int64_t i = begin; i < end; ++i) {
+        U k = toKey(key(input[i]));
+        lo = std::min(lo, k);
+        hi = std::max(hi, k);
+      }
+      chunkRanges[chunkIdx] = {lo, hi};
+    });
+    U lo = ~U{0}, hi = 0;
+    for (auto& [chunkLo, chunkHi] : chunkRanges) {
+      lo = std::min(lo, chunkLo);
+      hi = std::max(hi, chunkHi);
+    }
+    if (hi - lo >= static_cast<U>(maxCountingRange)) return false;
+    int64_t range = hi - lo + 1;
+    // Laid out as `range` offsets per chunk
+    std::vector<int64_t> offsets(chunkCnt * range);
+    parallel::forEachChunk(n, minChunkSize, [&](int64_t chunkIdx, int64_t begin, int64_t end) {
+      auto hist = offsets.data() + chunkIdx * range;
+      for (int64_t i = begin; i < end; ++i) ++hist[toKey(key(input[i])) - lo];
+    });
+    // As in `sortPairs`, earlier chunks write first within each key
+    int64_t writePos = 0;
+    for (int64_t bucket = 0; bucket < range; ++bucket) {
+      for (int64_t chunkIdx = 0; chunkIdx < chunkCnt; ++chunkIdx) {
+        auto& offset = offsets[chunkIdx * range + bucket];
+        auto cnt = offset;
+        offset = writePos;
+        writePos += cnt;
+      }
+    }
+    parallel::forEachChunk(n, minChunkSize, [&](int64_t chunkIdx, int64_t begin, int64_t end) {
+      auto writeOffsets = offsets.data() + chunkIdx * range;
+      for (int64_t i = begin; i < end; ++i) output[writeOffsets[toKey(key(input[i])) - lo]++] = input[i];
+    });
+    return true;
+  }
+
+  /// Stable sort of the integers in `inputData`. Writes the sorted values to
+  /// `sorted` and their original positions to `indices`.
+  template<typename T, typename IdxT>
+  void argsort(const std::vector<T>& inputData, std::vector<T>& sorted, std::vector<IdxT>& indices) {
+    static_assert(std::is_integral_v<T>, "radix argsort needs integer values");
+    int64_t n = inputData.size();
+    std::vector<std::make_unsigned_t<T>> keys(n);
+    indices.resize(n);
+    parallel::forEachChunk(n, minChunkSize, [&](int64_t, int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; ++i) {
+        keys[i] = toKey(inputData[i]);
+        indices[i] = i;
+      }
+    });
+    sortPairs(keys, indices);
+    sorted.resize(n);
+    parallel::forEachChunk(n, minChunkSize, [&](int64_t, int64_t begin, int64_t end) {
+      for (int64_t i = begin; i < end; ++i) sorted[i] = fromKey<T>(keys[i]);
+    });
+  }
+}
@@ -1,12 +1,19 @@
 #include <vector>
 #include <algorithm>
 #include <chrono>
+#include <limits>
+#include <type_traits>
 #include "mergesorttree.hpp"
+#include "dictionary.hpp"
+#include "orderedkey.hpp"
+#include "framebounds.hpp"
+#include "fenwicktree.hpp"
+#include "radixsort.hpp"
 
 
 template<typename T, typename T1, typename T2>
-std::vector<T> naiveRank(const std::vector<T>& inputData, T1 lowerBound, T2 upperBound) {
-  std::vector<T> result;
+std::vector<int64_t> naiveRank(const std::vector<T>& inputData, T1 lowerBound, T2 upperBound) {
+  std::vector<int64_t> result;
   result.reserve(inputData.size());
   for (size_t i = 0; i < inputData.size(); ++i) {
     auto lower = lowerBound(i, inputData.size());
@@ -23,18 +30,64 @@ std::vector<T> naiveRank(const std::vector<T>& inputData, T1 lowerBound, T2 uppe
 }
 
 
-template<int64_t fanout, int64_t cascading, typename T, typename T1, typename T2>
-std::vector<T> mergesortRank(const std::vector<T>& inputData, T1 lowerBound, T2 upperBound) {
-  auto tree = MergeSortTree<fanout, cascading, T>(std::vector<T>(inputData));
-
-  std::vector<T> result;
-  result.reserve(inputData.size());
-  for (size_t i = 0; i < inputData.size(); ++i) {
-    int64_t lower = lowerBound(i, inputData.size());
-    int64_t upper = upperBound(i, inputData.size());
-    auto v = inputData[i];
-    int64_t rank = tree.aggregateLowerBoundSum(lower, upper, v);
-    result.push_back(rank);
+/// Rank for frames which only grow, see `framebounds::growth`. Instead of
+/// building a tree, the rows are counted in a Fenwick tree over the sort order
+/// as they enter the frame. `CountT` must be able to hold the number of rows.
+template<typename CountT, typename T1, typename T2>
+std::vector<int64_t> growingFrameRank(const std::vector<int64_t>& inputData, framebounds::Growth growth, T1 lowerBound, T2 upperBound) {
+  using namespace std;
+  int64_t n = inputData.size();
+  vector<int64_t> sorted;
+  vector<CountT> indices;
+  radix::argsort(inputData, sorted, indices);
+  // Each row counts at the position of the first row with the same value in
+  // the sort order, so the prefix before its own position counts the smaller values
+  vector<CountT> positions(n);
+  for (int64_t i = 0, firstEqual = 0; i < n; ++i) {
+    if (sorted[i] != sorted[firstEqual]) firstEqual = i;
+    positions[indices[i]] = firstEqual;
   }
+  vector<int64_t> result(n);
+  FenwickTree<CountT> counts(n);
+  framebounds::visitGrowing(growth, lowerBound, upperBound, n,
+    [&](int64_t row) { counts.add(positions[row], 1); },
+    [&](int64_t row, int64_t /*lower*/, int64_t /*upper*/) { result[row] = counts.prefixSum(positions[row]); });
   return result;
 }
+
+
+/// Unless `prefixShortcut` is disabled, frames which only grow are computed
+/// with `growingFrameRank` instead of a tree
+template<int64_t fanout, int64_t cascading, bool prefixShortcut = true, typename T, typename T1, typename T2>
+std::vector<int64_t> mergesortRank(const std::vector<T>& inputData, T1 lowerBound, T2 upperBound) {
+  if constexpr (std::is_floating_point_v<T>) {
+    // The keys have the same order as the values, so the ranks are the same
+    return mergesortRank<fanout, cascading, prefixShortcut>(orderedkey::encode(inputData), lowerBound, upperBound);
+  } else if constexpr (!std::is_same_v<T, int64_t>) {
+    // The codes have the same order as the values, so the ranks are the same
+    Dictionary<T> dictionary(inputData);
+    return mergesortRank<fanout, cascading, prefixShortcut>(dictionary.codes, lowerBound, upperBound);
+  } else {
+    if constexpr (prefixShortcut) {
+      auto growth = framebounds::growth(lowerBound, upperBound, inputData.size());
+      if (growth != framebounds::Growth::None) {
+        if (inputData.size() <= static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+          return growingFrameRank<int32_t>(inputData, growth, lowerBound, upperBound);
+        }
+        return growingFrameRank<int64_t>(inputData, growth, lowerBound, upperBound);
+      }
+    }
+    auto tree = MergeSortTree<fanout, cascading, T>(std::vector<T>(inputData));
+
+    std::vector<int64_t> result;
+    result.reserve(inputData.size());
+    for (size_t i = 0; i < inputData.size(); ++i) {
+      int64_t lower = lowerBound(i, inputData.size());
+      int64_t upper = upperBound(i, inputData.size());
+      auto v = inputData[i];
+      int64_t rank = tree.aggregateLowerBoundSum(lower, upper, v);
+      result.push_back(rank);
+    }
+    return result;
+  }
+}
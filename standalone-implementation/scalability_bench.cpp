@@ -3,6 +3,7 @@
 #include "percentile.hpp"
 #include "rank.hpp"
 #include "mergesorttree.hpp"
+#include "memorypolicy.hpp"
 #include <array>
 #include <chrono>
 #include <cmath>
@@ -63,12 +64,22 @@ struct benchRankUnbounded {
     string prefix =
         "rank_unbounded\t" + to_string(fanout) + '\t' + to_string(cascading);
     repeatedTiming(prefix, inputs, [](const auto &in) {
-      return mergesortRank<fanout, cascading>(
+      return mergesortRank<fanout, cascading, false>(
           in, framebounds::unboundedPreceding, framebounds::untilCurrentRow);
     });
   }
 };
 
+/// Prefix frames without a tree, to compare against `benchRankUnbounded`
+struct benchRankUnboundedShortcut {
+  template <typename T> static void execute(const T &inputs) {
+    repeatedTiming("rank_unbounded_shortcut\t0\t0", inputs, [](const auto &in) {
+      return mergesortRank<2, 2>(in, framebounds::unboundedPreceding,
+                                 framebounds::untilCurrentRow);
+    });
+  }
+};
+
 struct benchRank2000 {
   template <int64_t fanout, int64_t cascading, typename T>
   static void execute(const T &inputs) {
@@ -87,13 +98,23 @@ struct benchMedianUnbounded {
     string prefix =
         "median_unbounded\t" + to_string(fanout) + '\t' + to_string(cascading);
     repeatedTiming(prefix, inputs, [](const auto &in) {
-      return mergesortPercentile<fanout, cascading>(
+      return mergesortPercentile<fanout, cascading, false, false>(
           in, framebounds::unboundedPreceding, framebounds::untilCurrentRow,
           0.5);
     });
   }
 };
 
+/// Prefix frames without a tree, to compare against `benchMedianUnbounded`
+struct benchMedianUnboundedShortcut {
+  template <typename T> static void execute(const T &inputs) {
+    repeatedTiming("median_unbounded_shortcut\t0\t0", inputs, [](const auto &in) {
+      return mergesortPercentile<2, 2>(in, framebounds::unboundedPreceding,
+                                       framebounds::untilCurrentRow, 0.5);
+    });
+  }
+};
+
 template <typename B, int64_t fanout, int64_t cascading, typename T>
 static void testCascadings(const T &inputs) {
   if constexpr (cascading > 0) {
@@ -118,36 +139,63 @@ static void testFanoutsAndCascading(const T &inputs) {
   }
 }
 
+/// Uniformly random inputs of the given sizes, or the first rows of
+/// `lineitemPrices` if it is not empty. Sizes beyond its rows are skipped.
+static vector<vector<int64_t>> makeInputs(const vector<int64_t> &sizes,
+                                          const vector<int64_t> &lineitemPrices) {
+  vector<vector<int64_t>> inputData;
+  for (int64_t size : sizes) {
+    if (lineitemPrices.empty()) {
+      inputData.push_back(data::uniformRandomInts(size, size * 5, 1));
+    } else if (size <= static_cast<int64_t>(lineitemPrices.size())) {
+      inputData.emplace_back(lineitemPrices.begin(), lineitemPrices.begin() + size);
+    }
+  }
+  return inputData;
+}
+
 int main(int argc, const char **argv) {
-  if (argc != 2) {
-    cerr << "wrong arguments\n";
+  // The optional second argument selects the memory policy of the trees,
+  // e.g. `thp,prefault,interleave`. See `memorypolicy::parse`. The optional
+  // third argument is a TPC-H `lineitem` file, whose prices replace the
+  // random inputs.
+  memorypolicy::Policy policy;
+  if (argc < 2 || argc > 4 || (argc >= 3 && !memorypolicy::parse(argv[2], policy))) {
+    cerr << "usage: " << argv[0] << " <experiment> [default|thp|hugetlb|prefault|interleave|local,...] [lineitem file]\n";
     return 1;
   }
+  memorypolicy::set(policy);
   auto experiment = atoi(argv[1]);
+  vector<int64_t> lineitemPrices;
+  if (argc == 4) {
+    try {
+      lineitemPrices = data::lineitemPrices(argv[3]);
+    } catch (const std::exception &e) {
+      cerr << e.what() << '\n';
+      return 1;
+    }
+  }
 
   cout << "algorithm\tfanout\tcascading\tinput_size\trun\ttime\n";
   if (experiment == 1) {
     vector<int64_t> sizes{10'000, 100'000, 1'000'000, 10'000'000, 100'000'000};
 
-    vector<vector<int64_t>> inputData;
-    for (int64_t size : sizes) {
-      inputData.push_back(data::uniformRandomInts(size, size * 5, 1));
-    }
+    auto inputData = makeInputs(sizes, lineitemPrices);
 
     // benchBuild::execute<64, 64>(inputData);
     testFanoutsAndCascading<benchRankUnbounded, 1024, 1024>(inputData);
+    benchRankUnboundedShortcut::execute(inputData);
     testFanoutsAndCascading<benchRank2000, 1024, 1024>(inputData);
   } else {
     vector<int64_t> sizes{1'000'000};
 
-    vector<vector<int64_t>> inputData;
-    for (int64_t size : sizes) {
-      inputData.push_back(data::uniformRandomInts(size, size * 5, 1));
-    }
+    auto inputData = makeInputs(sizes, lineitemPrices);
     if (experiment == 2) {
       testFanoutsAndCascading<benchRankUnbounded, 1024, 1024>(inputData);
+      benchRankUnboundedShortcut::execute(inputData);
       testFanoutsAndCascading<benchRank2000, 1024, 1024>(inputData);
       testFanoutsAndCascading<benchMedianUnbounded, 1024, 1024>(inputData);
+      benchMedianUnboundedShortcut::execute(inputData);
     } else if (experiment == 3) {
       // Used to observe memory consumption in `htop`
       benchBuild::execute<16, 4>(inputData);
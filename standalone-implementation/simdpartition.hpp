@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/// Vectorized partitioning of integers, and of pointers to integers by the
+/// values they point to.
+///
+/// The kernels partition in place: the first and last vector are set aside,
+/// which leaves room to write the elements less than the pivot to the front and
+/// all others to the back, one vector at a time. With AVX-512 each side is
+/// written with a compress store. AVX2 has no compress store, so a permutation
+/// from a lookup table moves the selected lanes to the front of the vector and
+/// all others to its back, and the whole vector is stored on both sides. For
+/// pointers, the keys are gathered from memory.
+///
+/// The instruction set is picked at runtime, so the binaries still run on CPUs
+/// without AVX2.
+namespace simdpartition {
+  enum class Isa { Scalar, Avx2, Avx512 };
+
+  /// Are there vectorized kernels for elements of type `T`, or for pointers to them?
+  template<typename T>
+  constexpr bool hasKernels = std::is_same_v<T, int32_t> || std::is_same_v<T, int64_t>;
+
+  namespace detail {
+    inline Isa supportedIsa() {
+#if defined(__x86_64__)
+      static Isa isa = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") ? Isa::Avx512
+        : __builtin_cpu_supports("avx2") ? Isa::Avx2 : Isa::Scalar;
+      return isa;
+#else
+      return Isa::Scalar;
+#endif
+    }
+    inline Isa& currentIsa() {
+      static Isa isa = supportedIsa();
+      return isa;
+    }
+
+    template<typename Elem, typename Key>
+    bool lessScalar(Elem e, Key pivot) {
+      if constexpr (std::is_pointer_v<Elem>) {
+        return *e < pivot;
+      } else {
+        return e < pivot;
+      }
+    }
+
+    template<typename Elem, typename Key>
+    int64_t partitionScalar(Elem* data, int64_t n, Key pivot) {
+      return std::partition(data, data + n, [pivot](Elem e) { return lessScalar(e, pivot); }) - data;
+    }
+
+    /// The in-place partitioning loop, see above. `Kernel::partition` splits
+    /// one vector of `Kernel::lanes` elements. No vector types cross this
+    /// function's boundary, as it is compiled without the kernel's target.
+    template<typename Kernel, typename Elem, typename Key>
+    int64_t partitionVectorized(Elem* data, int64_t n, Key pivot) {
+      constexpr int64_t lanes = Kernel::lanes;
+      Kernel kernel(pivot);
+      // Skip the prefix already less than the pivot and the suffix already not
+      // less, which is most of the data if it was partitioned around a nearby
+      // pivot before. Saves rewriting it.
+      int64_t skipped = 0;
+      while (n >= lanes && kernel.lessMask(data) == (uint32_t{1} << lanes) - 1) {
+        data += lanes;
+        n -= lanes;
+        skipped += lanes;
+      }
+      while (n >= lanes && kernel.lessMask(data + n - lanes) == 0) n -= lanes;
+      if (n < 3 * lanes) return skipped + partitionScalar(data, n, pivot);
+      // The two saved vectors and the unread rest exactly fill the final gap
+      std::array<Elem, 3 * lanes> rest;
+      std::copy(data, data + lanes, rest.data());
+      std::copy(data + n - lanes, data + n, rest.data() + lanes);
+      int64_t readLeft = lanes, readRight = n - lanes;
+      int64_t writeLeft = 0, writeRight = n;
+      // Both gaps together always span two vectors. Reading from the smaller
+      // gap ensures that both are at least one vector wide when writing.
+      while (readRight - readLeft >= lanes) {
+        const Elem* src;
+        if (readLeft - writeLeft <= writeRight - readRight) {
+          src = data + readLeft;
+          readLeft += lanes;
+        } else {
+          readRight -= lanes;
+          src = data + readRight;
+        }
+        int64_t lessCnt = kernel.partition(src, data + writeLeft, data + writeRight);
+        writeLeft += lessCnt;
+        writeRight -= lanes - lessCnt;
+      }
+      std::copy(data + readLeft, data + readRight, rest.data() + 2 * lanes);
+      int64_t restCnt = 2 * lanes + readRight - readLeft;
+      for (int64_t i = 0; i < restCnt; ++i) {
+        if (lessScalar(rest[i], pivot)) {
+          data[writeLeft++] = rest[i];
+        } else {
+          data[--writeRight] = rest[i];
+        }
+      }
+      assert(writeLeft == writeRight);
+      return skipped + writeLeft;
+    }
+
+#if defined(__x86_64__)
+    /// Indices for `_mm256_permutevar8x32_epi32` which move the 32-bit lanes
+    /// selected by the mask to the front, and all others to the back
+    inline const std::array<std::array<uint32_t, 8>, 256>& permutations32() {
+      static const auto table = [] {
+        std::array<std::array<uint32_t, 8>, 256> result{};
+        for (uint32_t mask = 0; mask < 256; ++mask) {
+          int pos = 0;
+          for (uint32_t lane = 0; lane < 8; ++lane) if (mask & (1u << lane)) result[mask][pos++] = lane;
+          for (uint32_t lane = 0; lane < 8; ++lane) if (!(mask & (1u << lane))) result[mask][pos++] = lane;
+        }
+        return result;
+      }();
+      return table;
+    }
+    /// The same for 64-bit lanes, as pairs of 32-bit lanes
+    inline const std::array<std::array<uint32_t, 8>, 16>& permutations64() {
+      static const auto table = [] {
+        std::array<std::array<uint32_t, 8>, 16> result{};
+        for (uint32_t mask = 0; mask < 16; ++mask) {
+          int pos = 0;
+          for (uint32_t lane = 0; lane < 4; ++lane) {
+            if (mask & (1u << lane)) {
+              result[mask][pos++] = 2 * lane;
+              result[mask][pos++] = 2 * lane + 1;
+            }
+          }
+          for (uint32_t lane = 0; lane < 4; ++lane) {
+            if (!(mask & (1u << lane))) {
+              result[mask][pos++] = 2 * lane;
+              result[mask][pos++] = 2 * lane + 1;
+            }
+          }
+        }
+        return result;
+      }();
+      return table;
+    }
+
+    /// Gathers the keys the pointers in `v` point to. The masked forms with a
+    /// zero source avoid reading the undefined source of the unmasked ones.
+    template<typename Key>
+    [[gnu::target("avx512f,avx512vl")]] inline auto gather512(__m512i v) {
+      if constexpr (sizeof(Key) == 8) {
+        return _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), 0xFF, v, nullptr, 1);
+      } else {
+        return _mm512_mask_i64gather_epi32(_mm256_setzero_si256(), 0xFF, v, nullptr, 1);
+      }
+    }
+
+    /// AVX-512 kernel for 32- or 64-bit elements, with `Key == Elem` or `Elem == const Key*`
+    template<typename Elem, typename Key>
+    struct Avx512Kernel {
+      static constexpr bool indirect = std::is_pointer_v<Elem>;
+      static constexpr int64_t lanes = 64 / sizeof(Elem);
+      using Vec = __m512i;
+      Key pivot;
+
+      Avx512Kernel(Key pivot) : pivot(pivot) {}
+      [[gnu::target("avx512f,avx512vl")]] uint32_t less(Vec v) const {
+        if constexpr (indirect && sizeof(Key) == 4) {
+          return _mm256_cmplt_epi32_mask(gather512<Key>(v), _mm256_set1_epi32(pivot));
+        } else if constexpr (indirect) {
+          return _mm512_cmplt_epi64_mask(gather512<Key>(v), _mm512_set1_epi64(pivot));
+        } else if constexpr (sizeof(Key) == 4) {
+          return _mm512_cmplt_epi32_mask(v, _mm512_set1_epi32(pivot));
+        } else {
+          return _mm512_cmplt_epi64_mask(v, _mm512_set1_epi64(pivot));
+        }
+      }
+      /// The lanes of `src` less than the pivot
+      [[gnu::target("avx512f,avx512vl")]] uint32_t lessMask(const Elem* src) const { return less(_mm512_loadu_si512(src)); }
+      /// Writes the elements of `src` less than the pivot to `left` and all
+      /// others to the elements before `rightEnd`. Returns the number of the former.
+      [[gnu::target("avx512f,avx512vl")]] int64_t partition(const Elem* src, Elem* left, Elem* rightEnd) const {
+        Vec v = _mm512_loadu_si512(src);
+        uint32_t mask = less(v);
+        int64_t lessCnt = __builtin_popcount(mask);
+        if constexpr (sizeof(Elem) == 4) {
+          _mm512_mask_compressstoreu_epi32(left, mask, v);
+          _mm512_mask_compressstoreu_epi32(rightEnd - (lanes - lessCnt), ~mask, v);
+        } else {
+          _mm512_mask_compressstoreu_epi64(left, mask, v);
+          _mm512_mask_compressstoreu_epi64(rightEnd - (lanes - lessCnt), ~mask, v);
+        }
+        return lessCnt;
+      }
+    };
+
+    /// AVX2 kernel for 32- or 64-bit elements, with `Key == Elem` or `Elem == const Key*`
+    template<typename Elem, typename Key>
+    struct Avx2Kernel {
+      static constexpr bool indirect = std::is_pointer_v<Elem>;
+      static constexpr int64_t lanes = 32 / sizeof(Elem);
+      using Vec = __m256i;
+      Key pivot;
+      const std::array<uint32_t, 8>* permutations;
+
+      Avx2Kernel(Key pivot) : pivot(pivot), permutations(sizeof(Elem) == 4 ? permutations32().data() : permutations64().data()) {}
+      [[gnu::target("avx2")]] uint32_t less(Vec v) const {
+        if constexpr (indirect && sizeof(Key) == 4) {
+          auto keys = _mm256_i64gather_epi32(static_cast<const int*>(nullptr), v, 1);
+          return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(_mm_set1_epi32(pivot), keys)));
+        } else if constexpr (indirect) {
+          auto keys = _mm256_i64gather_epi64(static_cast<const long long*>(nullptr), v, 1);
+          return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_set1_epi64x(pivot), keys)));
+        } else if constexpr (sizeof(Key) == 4) {
+          return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(pivot), v)));
+        } else {
+          return _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_set1_epi64x(pivot), v)));
+        }
+      }
+      /// The lanes of `src` less than the pivot
+      [[gnu::target("avx2")]] uint32_t lessMask(const Elem* src) const {
+        return less(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)));
+      }
+      /// Writes the elements of `src` less than the pivot to `left` and all
+      /// others to the elements before `rightEnd`. Returns the number of the
+      /// former. Needs a whole vector of space on both sides.
+      [[gnu::target("avx2")]] int64_t partition(const Elem* src, Elem* left, Elem* rightEnd) const {
+        Vec v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+        uint32_t mask = less(v);
+        auto indices = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(permutations[mask].data()));
+        auto permuted = _mm256_permutevar8x32_epi32(v, indices);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(left), permuted);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(rightEnd - lanes), permuted);
+        return __builtin_popcount(mask);
+      }
+    };
+
+    template<typename Elem, typename Key>
+    [[gnu::target("avx512f,avx512vl"), gnu::flatten]] int64_t partitionAvx512(Elem* data, int64_t n, Key pivot) {
+      return partitionVectorized<Avx512Kernel<Elem, Key>>(data, n, pivot);
+    }
+    template<typename Elem, typename Key>
+    [[gnu::target("avx2"), gnu::flatten]] int64_t partitionAvx2(Elem* data, int64_t n, Key pivot) {
+      return partitionVectorized<Avx2Kernel<Elem, Key>>(data, n, pivot);
+    }
+#endif
+
+    template<typename Elem, typename Key>
+    int64_t partitionLess(Elem* data, int64_t n, Key pivot) {
+#if defined(__x86_64__)
+      switch (currentIsa()) {
+        case Isa::Avx512: return partitionAvx512(data, n, pivot);
+        case Isa::Avx2: return partitionAvx2(data, n, pivot);
+        default: break;
+      }
+#endif
+      return partitionScalar(data, n, pivot);
+    }
+  }
+
+  /// The instruction set used by the kernels
+  inline Isa isa() { return detail::currentIsa(); }
+  /// Restricts the kernels to `isa`, or the best instruction set the CPU supports below it
+  inline void setIsa(Isa isa) { detail::currentIsa() = std::min(isa, detail::supportedIsa()); }
+
+  /// Reorders `[data, data + n)` so that the elements less than `pivot` come
+  /// first. Returns their number. The order within both parts is unspecified.
+  template<typename T>
+  int64_t partitionLess(T* data, int64_t n, T pivot) {
+    static_assert(hasKernels<T>, "no kernels for this type");
+    return detail::partitionLess(data, n, pivot);
+  }
+
+  /// Reorders the pointers `[data, data + n)` so that the ones pointing to
+  /// values less than `pivot` come first. Returns their number.
+  template<typename T>
+  int64_t partitionLess(const T** data, int64_t n, T pivot) {
+    static_assert(hasKernels<T>, "no kernels for this type");
+    return detail::partitionLess(data, n, pivot);
+  }
+}
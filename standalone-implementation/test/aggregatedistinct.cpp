@@ -59,6 +59,7 @@ TEMPLATE_TEST_CASE_SIG("mergesortCountDistint agrees with incrementalCountDistin
   auto checkIt = [&](auto bounds, auto lower, auto upper) {
     CAPTURE(bounds);
     CHECK(mergesortCountDistinct<fanout, cascading>(data, lower, upper) == incrementalCountDistinct(data, lower, upper));
+    CHECK(mergesortCountDistinct<fanout, cascading, true>(data, lower, upper) == incrementalCountDistinct(data, lower, upper));
   };
   checkIt("u,c", framebounds::unboundedPreceding, framebounds::untilCurrentRow);
   checkIt("c,u", framebounds::fromCurrentRow, framebounds::unboundedFollowing);
@@ -86,3 +87,88 @@ TEMPLATE_TEST_CASE_SIG("mergesortAggregateDistint agrees with incrementalAggrega
   checkIt("c,f", framebounds::fromCurrentRow, framebounds::nFollowing<3>);
   checkIt("c,o", framebounds::fromCurrentRow, framebounds::oscillating);
 }
+
+
+TEST_CASE("computePrevOffsetsSort agrees with computePrevOffsetsHash", "[distinct]") {
+  auto randomData = data::uniformRandomInts(300000, 1000, 3);
+  for (size_t i = 0; i < randomData.size(); i += 7) randomData[i] = -randomData[i] * 1000000007;
+  const auto& data = GENERATE_REF(as<vector<int64_t>>{}, data::values10, data::values20, randomData);
+  CAPTURE(data.size());
+  auto threadCount = GENERATE(1, 4);
+  parallel::ScopedThreadCount threads(threadCount);
+  CHECK(computePrevOffsetsSort(data) == computePrevOffsetsHash(data));
+}
+
+
+/// Compares results exactly for integers and approximately for floating point numbers.
+/// NaN, i.e. an empty result, is equal to NaN.
+template<typename T>
+bool sameResults(const vector<T>& a, const vector<T>& b) {
+  if constexpr (is_floating_point_v<T>) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+      if (isnan(a[i]) || isnan(b[i])) {
+        if (!isnan(a[i]) || !isnan(b[i])) return false;
+      } else if (fabs(a[i] - b[i]) > 1e-9 * max(1.0, fabs(a[i]))) {
+        return false;
+      }
+    }
+    return true;
+  } else {
+    return a == b;
+  }
+}
+
+
+TEMPLATE_TEST_CASE("all aggregates agree between naive, incremental and mergesort", "[distinct]",
+                   aggregates::count<int64_t>, aggregates::sum<int64_t>, aggregates::min<int64_t>, aggregates::max<int64_t>,
+                   aggregates::avg<int64_t>, aggregates::variance<int64_t>, aggregates::stddev<int64_t>) {
+  const auto& data = GENERATE_REF(as<vector<int64_t>>{}, data::values10, data::values20, data::uniformRandomInts(500, 100, 4));
+  CAPTURE(data);
+  auto checkIt = [&](auto bounds, auto lower, auto upper) {
+    CAPTURE(bounds);
+    auto expected = naiveAggregateDistinct<TestType>(data, lower, upper);
+    CHECK(sameResults(incrementalAggregateDistinct<TestType>(data, lower, upper), expected));
+    CHECK(sameResults(mergesortAggregateDistinct<2, 0, TestType>(data, lower, upper), expected));
+    CHECK(sameResults(mergesortAggregateDistinct<3, 1, TestType>(data, lower, upper), expected));
+    CHECK(sameResults(mergesortAggregateDistinct<4, 4, TestType>(data, lower, upper), expected));
+  };
+  checkIt("u,c", framebounds::unboundedPreceding, framebounds::untilCurrentRow);
+  checkIt("c,u", framebounds::fromCurrentRow, framebounds::unboundedFollowing);
+  checkIt("p,c", framebounds::nPreceding<3>, framebounds::untilCurrentRow);
+  checkIt("c,f", framebounds::fromCurrentRow, framebounds::nFollowing<3>);
+  checkIt("c,o", framebounds::fromCurrentRow, framebounds::oscillating);
+}
+
+
+TEST_CASE("non-invertible aggregates compute the right values", "[distinct]") {
+  vector<int64_t> data{4, 2, 1, 2};
+  auto lower = framebounds::unboundedPreceding;
+  auto upper = framebounds::untilCurrentRow;
+  CHECK(incrementalAggregateDistinct<aggregates::min<int64_t>>(data, lower, upper) == vector<int64_t>{4, 2, 1, 1});
+  CHECK(incrementalAggregateDistinct<aggregates::max<int64_t>>(data, lower, upper) == vector<int64_t>{4, 4, 4, 4});
+  auto avgs = incrementalAggregateDistinct<aggregates::avg<int64_t>>(data, lower, upper);
+  CHECK(sameResults(avgs, vector<double>{4, 3, 7.0/3, 7.0/3}));
+  // The distinct values {1, 2, 4} have the mean 7/3 and the sample variance 7/3
+  auto variances = mergesortAggregateDistinct<2, 0, aggregates::variance<int64_t>>(data, lower, upper);
+  CHECK(sameResults(variances, vector<double>{NAN, 2, 7.0/3, 7.0/3}));
+}
+
+
+TEST_CASE("mergesortAggregatesDistinct agrees with mergesortAggregateDistinct", "[distinct]") {
+  const auto& data = GENERATE_REF(as<vector<int64_t>>{}, data::values10, data::values20, data::uniformRandomInts(500, 100, 5));
+  CAPTURE(data);
+  using count = aggregates::count<int64_t>;
+  using sum = aggregates::sum<int64_t>;
+  using avg = aggregates::avg<int64_t>;
+  auto checkIt = [&](auto bounds, auto lower, auto upper) {
+    CAPTURE(bounds);
+    auto [counts, sums, avgs] = mergesortAggregatesDistinct<3, 3, count, sum, avg>(data, lower, upper);
+    CHECK(counts == mergesortAggregateDistinct<3, 3, count>(data, lower, upper));
+    CHECK(sums == mergesortAggregateDistinct<3, 3, sum>(data, lower, upper));
+    CHECK(sameResults(avgs, mergesortAggregateDistinct<3, 3, avg>(data, lower, upper)));
+  };
+  checkIt("u,c", framebounds::unboundedPreceding, framebounds::untilCurrentRow);
+  checkIt("p,c", framebounds::nPreceding<3>, framebounds::untilCurrentRow);
+  checkIt("c,o", framebounds::fromCurrentRow, framebounds::oscillating);
+}
@@ -0,0 +1,43 @@
+#include "catch.hpp"
+#include "cascadingoffsets.hpp"
+#include "mergesorttree.hpp"
+
+using namespace std;
+
+TEST_CASE("CascadingOffsets", "[cascadingoffsets]") {
+  SECTION("the entry width depends on the run length") {
+    CHECK(CascadingOffsets(65535, 65535, 8).entryWidth() == 2);
+    CHECK(CascadingOffsets(65536, 65536, 8).entryWidth() == 4);
+    // Runs padded beyond the end of a small level don't need wider pointers
+    CHECK(CascadingOffsets(1000, 65536, 8).entryWidth() == 2);
+    CHECK(CascadingOffsets(1, int64_t{1} << 32, 8).entryWidth() == 2);
+  }
+
+  SECTION("entries restore the absolute positions") {
+    // Three runs of length 8, the last one partial, with 6 entries each
+    constexpr int64_t runLength = 8, entriesPerRun = 6, len = 20;
+    CascadingOffsets offsets(len, runLength, entriesPerRun);
+    REQUIRE(offsets.size() == 3 * entriesPerRun);
+    for (int64_t idx = 0; idx < offsets.size(); ++idx) {
+      int64_t runBegin = idx / entriesPerRun * runLength;
+      int64_t pos = min(runBegin + idx % entriesPerRun + 2, len);
+      offsets.set(idx, runBegin, pos);
+      CAPTURE(idx);
+      CHECK(offsets[idx] == pos);
+      CHECK(offsets.position(idx, runBegin) == pos);
+    }
+  }
+
+  SECTION("trees only use wide pointers for long runs") {
+    constexpr int64_t n = 100000;
+    vector<int64_t> data(n);
+    for (int64_t i = 0; i < n; ++i) data[i] = (i * 7919) % n;
+    MergeSortTree<16, 4, int64_t> tree(move(data));
+    int64_t levelWidth = 1;
+    for (auto& level : tree.tree) {
+      CAPTURE(levelWidth);
+      if (level.second) CHECK(level.second.entryWidth() == (min(levelWidth, n) > 65535 ? 4 : 2));
+      levelWidth *= 16;
+    }
+  }
+}
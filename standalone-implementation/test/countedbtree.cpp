@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "catch.hpp"
+#include "countedbtree.hpp"
+
+using namespace std;
+
+TEST_CASE("CountedBTree", "[countedbtree]") {
+  SECTION("empty tree") {
+    CountedBTree<int64_t> tree;
+    CHECK(tree.empty());
+    CHECK(tree.size() == 0);
+  }
+
+  SECTION("ascending inserts and selects") {
+    CountedBTree<int64_t, 4, 4> tree;
+    for (int64_t i = 0; i < 1000; ++i) tree.insert(i);
+    REQUIRE(tree.size() == 1000);
+    for (int64_t i = 0; i < 1000; ++i) REQUIRE(tree.select(i) == i);
+    tree.clear();
+    CHECK(tree.empty());
+    tree.insert(5);
+    CHECK(tree.select(0) == 5);
+  }
+
+  SECTION("custom comparator") {
+    CountedBTree<int64_t, 4, 4, greater<int64_t>> tree;
+    for (int64_t i = 0; i < 100; ++i) tree.insert(i);
+    for (int64_t i = 0; i < 100; i += 2) tree.erase(i);
+    REQUIRE(tree.size() == 50);
+    for (int64_t k = 0; k < 50; ++k) REQUIRE(tree.select(k) == 99 - 2 * k);
+  }
+
+  SECTION("many node blocks") {
+    // Ascending inserts leave the leaves half full, so this needs far more
+    // than 64 blocks of leaves once they reach their largest size
+    CountedBTree<int64_t, 4, 4> tree;
+    for (int64_t round = 0; round < 2; ++round) {
+      for (int64_t i = 0; i < 300000; ++i) tree.insert(i);
+      REQUIRE(tree.size() == 300000);
+      for (int64_t i = 0; i < 300000; i += 997) REQUIRE(tree.select(i) == i);
+      tree.clear();
+    }
+  }
+
+  SECTION("nodes are reused after clearing") {
+    CountedBTree<int64_t, 4, 4> tree;
+    for (int round = 0; round < 3; ++round) {
+      for (int64_t i = 0; i < 2000; ++i) tree.insert((i * 7919) % 2000);
+      for (int64_t i = 0; i < 2000; i += 3) REQUIRE(tree.select(i) == i);
+      tree.clear();
+      CHECK(tree.empty());
+    }
+  }
+}
+
+TEMPLATE_TEST_CASE_SIG("CountedBTree agrees with a sorted vector", "[countedbtree]",
+                       ((int64_t leafCapacity, int64_t innerCapacity), leafCapacity, innerCapacity),
+                       (4, 4), (5, 7), (64, 32)) {
+  auto maxSize = GENERATE(10, 300, 5000);
+  CAPTURE(maxSize);
+  mt19937 gen(maxSize);
+  CountedBTree<pair<int32_t, int64_t>, leafCapacity, innerCapacity> tree;
+  vector<pair<int32_t, int64_t>> expected;
+  // Grow the tree, then let it shrink to nothing, to cover splits as well as merges
+  for (int64_t step = 0; step < 6 * maxSize; ++step) {
+    bool growing = step < 2 * maxSize || (step >= 3 * maxSize && step < 4 * maxSize);
+    bool doInsert = expected.empty() || (gen() % 4 != 0) == growing;
+    if (doInsert) {
+      pair<int32_t, int64_t> key{static_cast<int32_t>(gen() % 100), step};
+      tree.insert(key);
+      expected.insert(lower_bound(expected.begin(), expected.end(), key), key);
+    } else {
+      auto it = expected.begin() + gen() % expected.size();
+      tree.erase(*it);
+      expected.erase(it);
+    }
+    REQUIRE(tree.size() == static_cast<int64_t>(expected.size()));
+    if (!expected.empty()) {
+      int64_t k = gen() % expected.size();
+      CAPTURE(step, k);
+      REQUIRE(tree.select(k) == expected[k]);
+    }
+  }
+  for (int64_t k = 0; k < static_cast<int64_t>(expected.size()); ++k) REQUIRE(tree.select(k) == expected[k]);
+  while (!expected.empty()) {
+    tree.erase(expected.back());
+    expected.pop_back();
+    REQUIRE(tree.size() == static_cast<int64_t>(expected.size()));
+    if (!expected.empty()) REQUIRE(tree.select(expected.size() / 2) == expected[expected.size() / 2]);
+  }
+  CHECK(tree.empty());
+}
+
+TEMPLATE_TEST_CASE_SIG("CountedBTree::assign", "[countedbtree]",
+                       ((int64_t leafCapacity, int64_t innerCapacity), leafCapacity, innerCapacity),
+                       (4, 4), (5, 7), (64, 32)) {
+  // Sizes around the leaf and inner node capacities
+  auto n = GENERATE(0, 1, 2, 3, 5, 7, 9, 17, 48, 49, 97, 1000, 5000);
+  CAPTURE(n);
+  mt19937 gen(n);
+  vector<int64_t> expected(n);
+  for (int64_t i = 0; i < n; ++i) expected[i] = 2 * i;
+  CountedBTree<int64_t, leafCapacity, innerCapacity> tree;
+  // Assigning replaces the previous keys
+  tree.insert(-1);
+  tree.assign(expected.begin(), expected.end());
+  REQUIRE(tree.size() == n);
+  for (int64_t k = 0; k < n; ++k) REQUIRE(tree.select(k) == expected[k]);
+  // The bulk-built tree stays valid through later updates
+  for (int64_t step = 0; step < 2 * n + 10; ++step) {
+    if (expected.empty() || gen() % 2) {
+      int64_t key = 2 * static_cast<int64_t>(gen() % (n + 10)) + 1;
+      auto pos = lower_bound(expected.begin(), expected.end(), key);
+      if (pos != expected.end() && *pos == key) continue;
+      tree.insert(key);
+      expected.insert(pos, key);
+    } else {
+      auto it = expected.begin() + gen() % expected.size();
+      tree.erase(*it);
+      expected.erase(it);
+    }
+    REQUIRE(tree.size() == static_cast<int64_t>(expected.size()));
+    if (!expected.empty()) {
+      int64_t k = gen() % expected.size();
+      REQUIRE(tree.select(k) == expected[k]);
+    }
+  }
+  for (int64_t k = 0; k < static_cast<int64_t>(expected.size()); ++k) REQUIRE(tree.select(k) == expected[k]);
+}
@@ -0,0 +1,38 @@
+#include <string>
+#include "catch.hpp"
+#include "dictionary.hpp"
+#include "data.hpp"
+
+using namespace std;
+
+TEST_CASE("Dictionary", "[dictionary]") {
+  SECTION("assigns order-preserving dense codes") {
+    vector<string> input{"pear", "apple", "fig", "apple", "pear", "banana"};
+    Dictionary<string> dictionary(input);
+    CHECK(dictionary.values == vector<string>{"apple", "banana", "fig", "pear"});
+    CHECK(dictionary.codes == vector<int64_t>{3, 0, 2, 0, 3, 1});
+    CHECK(dictionary.decode(dictionary.codes) == input);
+    CHECK(dictionary.decode(-1) == "");
+  }
+
+  SECTION("handles empty input") {
+    Dictionary<string> dictionary(vector<string>{});
+    CHECK(dictionary.values.empty());
+    CHECK(dictionary.codes.empty());
+  }
+
+  SECTION("agrees between single- and multi-threaded encoding") {
+    auto values = data::uniformRandomInts(100000, 5000, 6);
+    vector<string> input;
+    for (auto v : values) input.push_back(to_string(v));
+    Dictionary<string> expected(input);
+    auto dictionary = [&] {
+      parallel::ScopedThreadCount threads(4);
+      return Dictionary<string>(input);
+    }();
+    CHECK(dictionary.values == expected.values);
+    CHECK(dictionary.codes == expected.codes);
+    CHECK(dictionary.decode(dictionary.codes) == input);
+    CHECK(is_sorted(dictionary.values.begin(), dictionary.values.end()));
+  }
+}
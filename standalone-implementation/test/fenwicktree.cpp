@@ -0,0 +1,26 @@
+#include <random>
+#include "catch.hpp"
+#include "fenwicktree.hpp"
+
+using namespace std;
+
+TEMPLATE_TEST_CASE("FenwickTree", "[fenwicktree]", int32_t, int64_t) {
+  auto size = GENERATE(1, 2, 7, 64, 1000);
+  CAPTURE(size);
+  FenwickTree<TestType> tree(size);
+  vector<TestType> counters(size);
+  REQUIRE(tree.size() == size);
+  REQUIRE(tree.prefixSum(size) == 0);
+  mt19937 gen(size);
+  for (int i = 0; i < 500; ++i) {
+    int64_t pos = gen() % size;
+    TestType delta = static_cast<TestType>(gen() % 7) - 2;
+    tree.add(pos, delta);
+    counters[pos] += delta;
+    int64_t end = gen() % (size + 1);
+    CAPTURE(pos, delta, end);
+    TestType expected = 0;
+    for (int64_t j = 0; j < end; ++j) expected += counters[j];
+    REQUIRE(tree.prefixSum(end) == expected);
+  }
+}
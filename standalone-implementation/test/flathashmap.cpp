@@ -0,0 +1,72 @@
+#include <unordered_map>
+#include "catch.hpp"
+#include "flathashmap.hpp"
+#include "data.hpp"
+
+using namespace std;
+
+TEST_CASE("FlatHashMap", "[flathashmap]") {
+  FlatHashMap<int64_t, int64_t> map;
+
+  SECTION("inserts and finds values") {
+    map[5] = 50;
+    map[-3] = 30;
+    map[1ll << 40] = 40;
+    CHECK(map.size() == 3);
+    REQUIRE(map.find(5));
+    CHECK(*map.find(5) == 50);
+    CHECK(*map.find(-3) == 30);
+    CHECK(*map.find(1ll << 40) == 40);
+    CHECK(!map.find(6));
+    CHECK(map[7] == 0);
+    CHECK(map.size() == 4);
+  }
+
+  SECTION("erases values") {
+    for (int64_t i = 0; i < 100; ++i) map[i] = i;
+    for (int64_t i = 0; i < 100; i += 2) CHECK(map.erase(i));
+    CHECK(!map.erase(0));
+    CHECK(map.size() == 50);
+    for (int64_t i = 0; i < 100; ++i) {
+      CAPTURE(i);
+      if (i % 2) {
+        REQUIRE(map.find(i));
+        CHECK(*map.find(i) == i);
+      } else {
+        CHECK(!map.find(i));
+      }
+    }
+  }
+
+  SECTION("clear keeps the map usable") {
+    for (int64_t i = 0; i < 1000; ++i) map[i * 7] = i;
+    map.clear();
+    CHECK(map.size() == 0);
+    CHECK(!map.find(7));
+    map[7] = 1;
+    CHECK(*map.find(7) == 1);
+    CHECK(map.size() == 1);
+  }
+
+  SECTION("agrees with std::unordered_map under random inserts and erases") {
+    auto ops = data::uniformRandomInts(20000, 500, 2);
+    unordered_map<int64_t, int64_t> expected;
+    for (size_t i = 0; i < ops.size(); ++i) {
+      auto key = ops[i] * 1024;
+      if (i % 3 == 2) {
+        CHECK(map.erase(key) == (expected.erase(key) != 0));
+      } else {
+        ++map[key];
+        ++expected[key];
+      }
+    }
+    REQUIRE(map.size() == static_cast<int64_t>(expected.size()));
+    int64_t visited = 0;
+    map.forEach([&](int64_t key, int64_t value) {
+      ++visited;
+      REQUIRE(expected.count(key));
+      CHECK(expected[key] == value);
+    });
+    CHECK(visited == map.size());
+  }
+}
@@ -0,0 +1,50 @@
+#include <algorithm>
+#include <vector>
+#include "catch.hpp"
+#include "framebounds.hpp"
+
+using namespace std;
+using framebounds::Growth;
+
+TEST_CASE("framebounds::growth", "[framebounds]") {
+  using namespace framebounds;
+  CHECK(growth(unboundedPreceding, untilCurrentRow, 10) == Growth::Prefix);
+  CHECK(growth(unboundedPreceding, nFollowing<3>, 10) == Growth::Prefix);
+  CHECK(growth(unboundedPreceding, unboundedFollowing, 10) == Growth::Prefix);
+  CHECK(growth(fromCurrentRow, unboundedFollowing, 10) == Growth::Suffix);
+  CHECK(growth(nPreceding<3>, unboundedFollowing, 10) == Growth::Suffix);
+  CHECK(growth(nPreceding<3>, untilCurrentRow, 10) == Growth::None);
+  CHECK(growth(fromCurrentRow, nFollowing<3>, 10) == Growth::None);
+  CHECK(growth(unboundedPreceding, oscillating, 10) == Growth::None);
+  // The first rows of a sliding frame look like a prefix
+  CHECK(growth(nPreceding<3>, untilCurrentRow, 3) == Growth::Prefix);
+}
+
+TEST_CASE("framebounds::visitGrowing", "[framebounds]") {
+  using namespace framebounds;
+  auto check = [](auto lower, auto upper) {
+    constexpr int64_t end = 10;
+    auto g = growth(lower, upper, end);
+    REQUIRE(g != Growth::None);
+    vector<bool> inserted(end);
+    vector<int64_t> visited;
+    visitGrowing(g, lower, upper, end,
+      [&](int64_t row) {
+        REQUIRE(!inserted[row]);
+        inserted[row] = true;
+      },
+      [&](int64_t row, int64_t frameBegin, int64_t frameEnd) {
+        REQUIRE(frameBegin == lower(row, end));
+        REQUIRE(frameEnd == upper(row, end));
+        for (int64_t j = 0; j < end; ++j) REQUIRE(inserted[j] == (j >= frameBegin && j < frameEnd));
+        visited.push_back(row);
+      });
+    REQUIRE(static_cast<int64_t>(visited.size()) == end);
+    if (g == Growth::Suffix) reverse(visited.begin(), visited.end());
+    for (int64_t i = 0; i < end; ++i) CHECK(visited[i] == i);
+  };
+  SECTION("prefix") { check(unboundedPreceding, untilCurrentRow); }
+  SECTION("prefix with following rows") { check(unboundedPreceding, nFollowing<3>); }
+  SECTION("suffix") { check(fromCurrentRow, unboundedFollowing); }
+  SECTION("suffix with preceding rows") { check(nPreceding<3>, unboundedFollowing); }
+}
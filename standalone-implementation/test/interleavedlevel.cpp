@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <random>
+#include "catch.hpp"
+#include "interleavedlevel.hpp"
+#include "mergesorttree.hpp"
+
+using namespace std;
+
+TEST_CASE("InterleavedLevel", "[interleavedlevel]") {
+  SECTION("levels without pointers") {
+    vector<int32_t> values{5, 1, 4, 2, 8, 7, 3};
+    InterleavedLevel<int32_t, 4, 2> level(values, CascadingOffsets{}, 2);
+    REQUIRE(level.size() == 7);
+    CHECK(!level.hasCascadingOffsets());
+    for (int64_t i = 0; i < level.size(); ++i) CHECK(level[i] == values[i]);
+    CHECK(level.memoryUsage() == 8 * sizeof(int32_t));
+  }
+
+  SECTION("elements and pointers") {
+    // Two runs of length 16, the second one partial, with one row per 4 elements
+    constexpr int64_t fanout = 2, cascading = 4, runLength = 16, len = 22;
+    vector<int64_t> values(len);
+    for (int64_t i = 0; i < len; ++i) values[i] = i % runLength * 3;
+    constexpr int64_t entriesPerRun = (2 + runLength / cascading) * fanout;
+    CascadingOffsets offsets(len, runLength, entriesPerRun);
+    for (int64_t idx = 0; idx < offsets.size(); ++idx) {
+      int64_t runBegin = idx / entriesPerRun * runLength;
+      offsets.set(idx, runBegin, min(runBegin + idx % runLength, len));
+    }
+    InterleavedLevel<int64_t, fanout, cascading> level(values, offsets, runLength);
+    CHECK(level.hasCascadingOffsets());
+    for (int64_t i = 0; i < len; ++i) {
+      CAPTURE(i);
+      CHECK(level[i] == values[i]);
+    }
+    // All rows up to the terminators of the last run are kept
+    for (int64_t idx = 0; idx < (len / cascading + 1 + 2 + 2) * fanout; ++idx) {
+      CAPTURE(idx);
+      int64_t runBegin = idx / entriesPerRun * runLength;
+      CHECK(level.cascadingPosition(idx, runBegin) == offsets.position(idx, runBegin));
+    }
+    // Each block of 2 pointers and 4 elements is padded to 32 bytes
+    CHECK(level.memoryUsage() % 32 == 0);
+    CHECK(lowerBound(level, 0, 16, 7) == 3);
+    CHECK(lowerBound(level, 16, len, 9) == 19);
+    CHECK(lowerBound(level, 16, len, 100) == len);
+  }
+}
+
+TEMPLATE_TEST_CASE_SIG("MergeSortTree with interleaved levels", "[interleavedlevel]",
+                       ((int64_t fanout, int64_t cascading), fanout, cascading),
+                       (2, 1), (2, 2), (3, 3), (4, 2), (4, 4), (16, 4), (32, 32)) {
+  auto n = GENERATE(1, 2, 7, 100, 5000);
+  CAPTURE(n);
+  vector<int32_t> permutation(n);
+  for (int i = 0; i < n; ++i) permutation[i] = i;
+  mt19937 gen(n);
+  shuffle(permutation.begin(), permutation.end(), gen);
+
+  using Interleaved = InterleavedLevel<int32_t, fanout, cascading>;
+  MergeSortTree<fanout, cascading, int32_t, int32_t> expected(vector<int32_t>{permutation});
+  MergeSortTree<fanout, cascading, int32_t, int32_t, Interleaved> merged(vector<int32_t>{permutation});
+  auto partitioned = MergeSortTree<fanout, cascading, int32_t, int32_t, Interleaved>::fromPermutation(vector<int32_t>{permutation});
+  for (int i = 0; i < 200; ++i) {
+    int64_t lower = gen() % n;
+    int64_t upper = lower + 1 + gen() % (n - lower);
+    int64_t needle = gen() % (n + 1);
+    CAPTURE(lower, upper, needle);
+    auto count = expected.aggregateLowerBoundSum(lower, upper, needle);
+    REQUIRE(merged.aggregateLowerBoundSum(lower, upper, needle) == count);
+    REQUIRE(partitioned.aggregateLowerBoundSum(lower, upper, needle) == count);
+    if (upper - lower > 1) {
+      int32_t nth = gen() % (upper - lower);
+      auto selected = expected.selectNth(lower, upper, nth);
+      REQUIRE(merged.selectNth(lower, upper, nth) == selected);
+      REQUIRE(partitioned.selectNth(lower, upper, nth) == selected);
+    }
+  }
+}
@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <random>
+#include "catch.hpp"
+#include "levelsummary.hpp"
+#include "mergesorttree.hpp"
+
+using namespace std;
+
+TEST_CASE("LevelSummary", "[levelsummary]") {
+  SECTION("small levels are not summarized") {
+    vector<int64_t> level{1, 2, 3, 4};
+    LevelSummary<int64_t> summary(level, 4);
+    CHECK(summary.empty());
+    CHECK(summary.memoryUsage() == 0);
+  }
+
+  SECTION("narrowed searches agree with full searches") {
+    // Sorted runs of 1000 elements with duplicates, the last one partial
+    constexpr int64_t runLength = 1000, len = 4321;
+    mt19937 gen(42);
+    vector<int32_t> level(len);
+    for (auto& v : level) v = gen() % 2000;
+    for (int64_t begin = 0; begin < len; begin += runLength) {
+      sort(level.begin() + begin, level.begin() + min(begin + runLength, len));
+    }
+    LevelSummary<int32_t> summary(level, 64);
+    REQUIRE(!summary.empty());
+    CHECK(summary.memoryUsage() <= 2 * 64 * static_cast<int64_t>(sizeof(int32_t)));
+    for (int i = 0; i < 2000; ++i) {
+      int64_t runBegin = gen() % len / runLength * runLength;
+      int64_t runEnd = min(runBegin + runLength, len);
+      int64_t begin = runBegin + gen() % (runEnd - runBegin);
+      int64_t end = begin + gen() % (runEnd - begin + 1);
+      int32_t needle = static_cast<int32_t>(gen() % 2002) - 1;
+      CAPTURE(begin, end, needle);
+      auto [lo, hi] = summary.narrow(begin, end, needle);
+      REQUIRE(begin <= lo);
+      REQUIRE(lo <= hi);
+      REQUIRE(hi <= end);
+      CHECK(hi - lo <= 128);
+      CHECK(lowerBound(level, lo, hi, needle) == lowerBound(level, begin, end, needle));
+    }
+  }
+}
+
+TEMPLATE_TEST_CASE_SIG("MergeSortTree with level summaries", "[levelsummary]",
+                       ((int64_t fanout, int64_t cascading), fanout, cascading),
+                       (2, 0), (2, 2), (4, 4), (16, 4), (64, 64)) {
+  // Large enough for the upper levels to be summarized
+  constexpr int32_t n = 100000;
+  vector<int32_t> permutation(n);
+  for (int i = 0; i < n; ++i) permutation[i] = i;
+  mt19937 gen(fanout + cascading);
+  shuffle(permutation.begin(), permutation.end(), gen);
+  MergeSortTree<fanout, cascading, int32_t, int32_t> merged(vector<int32_t>{permutation});
+  auto partitioned = MergeSortTree<fanout, cascading, int32_t, int32_t>::fromPermutation(vector<int32_t>{permutation});
+  for (int i = 0; i < 100; ++i) {
+    int64_t lower = gen() % n;
+    int64_t upper = lower + 1 + gen() % (n - lower);
+    int64_t needle = gen() % (n + 1);
+    CAPTURE(lower, upper, needle);
+    auto count = count_if(permutation.begin() + lower, permutation.begin() + upper, [&](int32_t v) { return v < needle; });
+    REQUIRE(merged.aggregateLowerBoundSum(lower, upper, needle) == count);
+    REQUIRE(partitioned.aggregateLowerBoundSum(lower, upper, needle) == count);
+    // Select among the positions of the values in `[lower, upper)`
+    int32_t nth = gen() % (upper - lower);
+    int64_t expected = 0;
+    for (int32_t remaining = nth + 1; ; ++expected) {
+      remaining -= permutation[expected] >= lower && permutation[expected] < upper;
+      if (!remaining) break;
+    }
+    REQUIRE(merged.selectNth(lower, upper, nth) == static_cast<size_t>(expected));
+    REQUIRE(partitioned.selectNth(lower, upper, nth) == static_cast<size_t>(expected));
+  }
+}
@@ -0,0 +1,191 @@
+#include <charconv>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <system_error>
+#include "catch.hpp"
+#include "lineitem.hpp"
+
+using namespace std;
+
+namespace {
+  /// Random rows in the format of `dbgen`, together with the values we expect
+  struct GeneratedRows {
+    string text;
+    lineitem::Table expected;
+  };
+
+  GeneratedRows generateRows(int64_t rowCnt, char delimiter, bool trailingDelimiter, uint64_t seed) {
+    GeneratedRows result;
+    auto& expected = result.expected;
+    expected.rowCnt = rowCnt;
+    mt19937_64 gen(seed);
+    for (int64_t row = 0; row < rowCnt; ++row) {
+      int64_t orderKey = gen() % 6000000 + 1;
+      int64_t lineNumber = gen() % 7 + 1;
+      int64_t quantityCents = (gen() % 50 + 1) * 100;
+      // Prices may use all digits of the fast path
+      int64_t priceCents = gen() % 2 ? gen() % 10000000 : gen() % 1000000000000000;
+      int32_t year = 1992 + gen() % 7, month = gen() % 12 + 1, day = gen() % 28 + 1;
+      char flag = "RAN"[gen() % 3];
+      char buffer[512];
+      snprintf(buffer, sizeof(buffer), "%ld%c%ld%c%ld%c%ld%c%ld.%02ld%c%ld.%02ld%c0.0%ld%c0.0%ld%c%c%cO%c%04d-%02d-%02d%c1996-01-01%c1996-01-31%cNONE%cTRUCK%ccomment %ld%s\n",
+               orderKey, delimiter, row, delimiter, -row, delimiter, lineNumber, delimiter,
+               quantityCents / 100, quantityCents % 100, delimiter, priceCents / 100, priceCents % 100, delimiter,
+               row % 10, delimiter, row % 9, delimiter, flag, delimiter, delimiter,
+               year, month, day, delimiter, delimiter, delimiter, delimiter, delimiter, row,
+               trailingDelimiter ? string(1, delimiter).c_str() : "");
+      result.text += buffer;
+      expected.orderKey.push_back(orderKey);
+      expected.lineNumber.push_back(lineNumber);
+      expected.quantity.push_back(quantityCents / 100);
+      // The reference conversion
+      string price = to_string(priceCents / 100) + "." + (priceCents % 100 < 10 ? "0" : "") + to_string(priceCents % 100);
+      double priceValue;
+      from_chars(price.data(), price.data() + price.size(), priceValue);
+      expected.extendedPrice.push_back(priceValue);
+      expected.discount.push_back((row % 10) / 100.0);
+      expected.returnFlag.push_back(flag);
+      expected.shipDate.push_back(lineitem::detail::daysFromCivil(year, month, day));
+    }
+    return result;
+  }
+
+  void checkRows(const lineitem::Table& table, const lineitem::Table& expected) {
+    REQUIRE(table.rowCnt == expected.rowCnt);
+    CHECK(table.orderKey == expected.orderKey);
+    CHECK(table.lineNumber == expected.lineNumber);
+    CHECK(table.quantity == expected.quantity);
+    CHECK(table.extendedPrice == expected.extendedPrice);
+    CHECK(table.discount == expected.discount);
+    CHECK(table.returnFlag == expected.returnFlag);
+    CHECK(table.shipDate == expected.shipDate);
+    // Columns which were not requested stay empty
+    CHECK(table.partKey.empty());
+    CHECK(table.tax.empty());
+    CHECK(table.receiptDate.empty());
+  }
+
+  /// A unique path in the temp directory. The file, and the temporary file of
+  /// `lineitem::save`, are removed when the guard goes out of scope.
+  struct TempPath {
+    filesystem::path path;
+
+    explicit TempPath(const string& extension) {
+      static mt19937_64 gen(random_device{}());
+      path = filesystem::temp_directory_path() / ("lineitem_test_" + to_string(gen()) + extension);
+    }
+    ~TempPath() {
+      error_code ec;
+      filesystem::remove(path, ec);
+      filesystem::remove(path.string() + ".tmp", ec);
+    }
+    TempPath(const TempPath&) = delete;
+    TempPath& operator=(const TempPath&) = delete;
+  };
+
+  using C = lineitem::Column;
+  const initializer_list<C> checkedColumns = {C::OrderKey, C::LineNumber, C::Quantity, C::ExtendedPrice, C::Discount, C::ReturnFlag, C::ShipDate};
+}
+
+TEST_CASE("lineitem::parse", "[lineitem]") {
+  auto threadCount = GENERATE(1, 4);
+  auto rowCnt = GENERATE(0, 1, 3, 1000);
+  auto [delimiter, trailingDelimiter] = GENERATE(pair{'\t', false}, pair{'|', true});
+  CAPTURE(threadCount, rowCnt, delimiter);
+  parallel::ScopedThreadCount threads(threadCount);
+  auto rows = generateRows(rowCnt, delimiter, trailingDelimiter, rowCnt);
+
+  SECTION("agrees with the reference conversion") {
+    // Small chunks, so that many chunk boundaries fall into rows
+    checkRows(lineitem::parse(rows.text, checkedColumns, delimiter, 1000), rows.expected);
+    checkRows(lineitem::parse(rows.text, checkedColumns, delimiter), rows.expected);
+  }
+
+  SECTION("accepts a last line without line end") {
+    if (!rows.text.empty()) rows.text.pop_back();
+    checkRows(lineitem::parse(rows.text, checkedColumns, delimiter, 1000), rows.expected);
+  }
+}
+
+TEST_CASE("lineitem::parse rejects malformed rows", "[lineitem]") {
+  auto rows = generateRows(100, '\t', false, 1);
+  auto lineBegin = [&](int64_t row) {
+    size_t pos = 0;
+    for (int64_t i = 0; i < row; ++i) pos = rows.text.find('\n', pos) + 1;
+    return pos;
+  };
+  auto checkError = [&](const string& text, const string& message) {
+    parallel::ScopedThreadCount threads(4);
+    CHECK_THROWS_WITH(lineitem::parse(text, checkedColumns, '\t', 1000), message);
+  };
+
+  SECTION("missing columns") {
+    auto text = rows.text;
+    auto lineEnd = lineBegin(43) - 1;
+    auto lastColumn = text.rfind('\t', lineEnd);
+    text.erase(lastColumn, lineEnd - lastColumn);
+    checkError(text, "lineitem row 43: only 15 columns");
+  }
+  SECTION("additional columns") {
+    auto text = rows.text;
+    text.insert(lineBegin(43) - 1, "\textra");
+    checkError(text, "lineitem row 43: more than 16 columns");
+  }
+  SECTION("invalid numbers") {
+    auto text = rows.text;
+    text.insert(lineBegin(17), "x");
+    checkError(text, "lineitem row 18: invalid value in column 1");
+  }
+  SECTION("invalid dates") {
+    auto text = rows.text;
+    auto dateBegin = text.find("1996-01-01", lineBegin(99)) - 11;
+    text[dateBegin + 5] = '1';
+    text[dateBegin + 6] = '3';
+    checkError(text, "lineitem row 100: invalid value in column 11");
+  }
+  SECTION("empty lines") {
+    checkError(rows.text + "\n", "lineitem row 101: only 1 columns");
+  }
+}
+
+TEST_CASE("lineitem::load", "[lineitem]") {
+  auto rows = generateRows(5000, '|', true, 2);
+  TempPath file(".tbl");
+  ofstream(file.path) << rows.text;
+  checkRows(lineitem::load(file.path.string(), checkedColumns, '|'), rows.expected);
+  filesystem::remove(file.path);
+  CHECK_THROWS(lineitem::load(file.path.string(), checkedColumns));
+  CHECK(lineitem::detail::daysFromCivil(1970, 1, 1) == 0);
+  CHECK(lineitem::detail::daysFromCivil(2000, 3, 1) == 11017);
+  CHECK(lineitem::detail::daysFromCivil(1969, 12, 31) == -1);
+}
+
+TEST_CASE("lineitem::save", "[lineitem]") {
+  auto rowCnt = GENERATE(0, 1, 5000);
+  CAPTURE(rowCnt);
+  auto rows = generateRows(rowCnt, '\t', false, rowCnt);
+  TempPath file(".columns");
+  auto& path = file.path;
+  lineitem::save(lineitem::parse(rows.text, checkedColumns), path.string());
+
+  SECTION("load copies the saved columns") {
+    {
+      parallel::ScopedThreadCount threads(4);
+      checkRows(lineitem::load(path.string(), checkedColumns), rows.expected);
+    }
+    auto prices = lineitem::load(path.string(), {C::ExtendedPrice});
+    CHECK(prices.extendedPrice == rows.expected.extendedPrice);
+    CHECK(prices.orderKey.empty());
+  }
+  SECTION("load rejects columns which were not saved") {
+    // Without rows, all columns are complete
+    if (rowCnt > 0) CHECK_THROWS_WITH(lineitem::load(path.string(), {C::ShipDate, C::Tax}), "column 8 is not in the lineitem cache");
+  }
+  SECTION("load rejects truncated files") {
+    filesystem::resize_file(path, filesystem::file_size(path) - 1);
+    CHECK_THROWS_WITH(lineitem::load(path.string(), checkedColumns), "truncated lineitem cache");
+  }
+}
@@ -1,6 +1,35 @@
+#include <algorithm>
+#include <optional>
+#include <random>
+#include <vector>
 #include "catch.hpp"
 #include "losertree.hpp"
 
+namespace {
+  /// Merges the sorted `inputs` with `tree` and checks that the merge yields
+  /// the `expected` keys together with the inputs they came from
+  template<typename Key, int64_t fanout>
+  void checkMerge(LoserTree<Key, fanout>& tree, const std::vector<std::vector<Key>>& inputs,
+                  const std::vector<std::pair<Key, int64_t>>& expected) {
+    std::vector<int64_t> positions(inputs.size(), 0);
+    tree.reset([&](int64_t i) -> std::optional<Key> {
+      if (inputs[i].empty()) return std::nullopt;
+      return inputs[i][0];
+    });
+    std::vector<std::pair<Key, int64_t>> merged;
+    while (!tree.empty()) {
+      auto input = tree.winner();
+      merged.emplace_back(tree.winnerKey(), input);
+      if (++positions[input] < static_cast<int64_t>(inputs[input].size())) {
+        tree.replaceWinner(inputs[input][positions[input]]);
+      } else {
+        tree.exhaustWinner();
+      }
+    }
+    REQUIRE(merged == expected);
+  }
+}
+
 TEST_CASE("makeLoserTree", "[losertree]") {
   SECTION("elements is a power of two") {
     std::array<int64_t, 8> input{2, 1, 3, 5, 4, 3, 7, 6};
@@ -46,3 +75,41 @@ TEST_CASE("updateLoserTree", "[losertree]") {
   std::array<int64_t, 7> expectedTree{6, 3, 99, 8, 4, 99, 99};
   CHECK(loserTree == expectedTree);
 }
+
+TEMPLATE_TEST_CASE_SIG("LoserTree", "[losertree]", ((int64_t fanout), fanout), 2, 5, 16, 1000) {
+  using Entry = std::pair<int64_t, int64_t>;
+  LoserTree<int64_t, fanout> tree;
+  std::mt19937 gen(fanout);
+  // The tree is reused for all merges
+  for (int round = 0; round < 10; ++round) {
+    CAPTURE(round);
+    // Sorted inputs of random lengths, some of them empty, with many duplicates
+    std::vector<std::vector<int64_t>> inputs(fanout);
+    std::vector<Entry> expected;
+    for (int64_t i = 0; i < fanout; ++i) {
+      inputs[i].resize(gen() % 3 == 0 ? 0 : gen() % 20);
+      for (auto& v : inputs[i]) v = gen() % 50;
+      std::sort(inputs[i].begin(), inputs[i].end());
+      for (auto v : inputs[i]) expected.emplace_back(v, i);
+    }
+    // Equal keys come out ordered by input
+    std::sort(expected.begin(), expected.end());
+    checkMerge(tree, inputs, expected);
+  }
+}
+
+TEST_CASE("LoserTree with extreme keys", "[losertree]") {
+  // No key is reserved as a sentinel
+  constexpr auto maxKey = std::numeric_limits<int64_t>::max();
+  LoserTree<int64_t, 3> tree;
+  checkMerge<int64_t>(tree, {{maxKey, maxKey}, {}, {0, maxKey}}, {{0, 2}, {maxKey, 0}, {maxKey, 0}, {maxKey, 2}});
+
+  tree.reset([](int64_t) -> std::optional<int64_t> { return std::nullopt; });
+  CHECK(tree.empty());
+}
+
+TEST_CASE("LoserTree with infinite keys", "[losertree]") {
+  constexpr auto inf = std::numeric_limits<double>::infinity();
+  LoserTree<double, 2> tree;
+  checkMerge<double>(tree, {{inf}, {1.5, inf}}, {{1.5, 1}, {inf, 0}, {inf, 1}});
+}
@@ -1,2 +1,5 @@
 #define CATCH_CONFIG_MAIN
+// Catch2 v2 sizes its alternate signal stack with `MINSIGSTKSZ`, which is no
+// longer a constant expression on recent glibc versions
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
 #include "catch.hpp"
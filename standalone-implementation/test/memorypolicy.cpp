@@ -0,0 +1,52 @@
+#include <algorithm>
+#include "catch.hpp"
+#include "memorypolicy.hpp"
+#include "mergesorttree.hpp"
+
+using namespace std;
+
+TEST_CASE("memorypolicy parsing", "[memorypolicy]") {
+  memorypolicy::Policy policy;
+  REQUIRE(memorypolicy::parse("thp,prefault,interleave", policy));
+  CHECK(policy.hugePages == memorypolicy::HugePages::Transparent);
+  CHECK(policy.placement == memorypolicy::Placement::Interleave);
+  CHECK(policy.prefault);
+  REQUIRE(memorypolicy::parse("hugetlb,local", policy));
+  CHECK(policy.hugePages == memorypolicy::HugePages::Explicit);
+  CHECK(policy.placement == memorypolicy::Placement::Local);
+  CHECK(!policy.prefault);
+  REQUIRE(memorypolicy::parse("default", policy));
+  CHECK(policy.hugePages == memorypolicy::HugePages::None);
+  CHECK(!memorypolicy::parse("thp,gigantic", policy));
+}
+
+TEST_CASE("memorypolicy allocations", "[memorypolicy]") {
+  auto spec = GENERATE(as<string>(), "default", "thp,prefault", "hugetlb,interleave", "local,prefault");
+  CAPTURE(spec);
+  memorypolicy::Policy policy;
+  REQUIRE(memorypolicy::parse(spec, policy));
+  memorypolicy::set(policy);
+
+  SECTION("allocations are zeroed") {
+    for (int64_t count : {int64_t{10}, int64_t{3} << 20}) {
+      auto array = memorypolicy::makeUniqueArray<uint32_t>(count);
+      CHECK(all_of(array.get(), array.get() + count, [](uint32_t x) { return x == 0; }));
+      array[count - 1] = 42;
+    }
+  }
+
+  SECTION("trees are independent of the policy") {
+    constexpr int64_t n = 1 << 20;
+    vector<int64_t> data(n);
+    for (int64_t i = 0; i < n; ++i) data[i] = (i * 7919) % n;
+    MergeSortTree<16, 4, int64_t> tree(vector<int64_t>{data});
+    auto permutation = MergeSortTree<16, 4, int64_t>::fromPermutation(vector<int64_t>{data});
+    memorypolicy::set({});
+    MergeSortTree<16, 4, int64_t> expected(vector<int64_t>{data});
+    for (int64_t lower : {int64_t{0}, n / 3}) {
+      CHECK(tree.aggregateLowerBoundSum(lower, n, n / 2) == expected.aggregateLowerBoundSum(lower, n, n / 2));
+      CHECK(permutation.aggregateLowerBoundSum(lower, n, n / 2) == expected.aggregateLowerBoundSum(lower, n, n / 2));
+    }
+  }
+  memorypolicy::set({});
+}
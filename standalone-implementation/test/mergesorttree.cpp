@@ -1,4 +1,6 @@
 #include <unordered_set>
+#include <random>
+#include <algorithm>
 #include "catch.hpp"
 #include "mergesorttree.hpp"
 
@@ -44,3 +46,138 @@ TEMPLATE_TEST_CASE_SIG("MergeSortTree Constructor", "[mergesorttree]",
     levelWidth *= fanout;
   }
 }
+
+
+TEMPLATE_TEST_CASE_SIG("MergeSortTree Constructor visits the payload", "[mergesorttree]",
+                       ((unsigned fanout), fanout), (2), (3), (4)) {
+  auto data = GENERATE(
+    vector<int64_t>{1, 8, 2, 5, 9, 3, 0, 7},
+    vector<int64_t>{2, 2, 1, 4, 5, 1, 6, 1, 8, 3, 1}
+    );
+  CAPTURE(data);
+
+  // Use the original position as payload
+  vector<int64_t> positions;
+  for (size_t i = 0; i < data.size(); ++i) positions.push_back(i);
+  vector<vector<int64_t>> visitedPayloads;
+  auto visit = [&](int64_t level, int64_t runBegin, int64_t pos, int64_t elem, int64_t payload) {
+    if (level == static_cast<int64_t>(visitedPayloads.size())) visitedPayloads.emplace_back();
+    CHECK(pos == static_cast<int64_t>(visitedPayloads[level].size()));
+    CHECK(runBegin <= pos);
+    CHECK(elem == data[payload]);
+    visitedPayloads[level].push_back(payload);
+  };
+  auto smtree = MergeSortTree<fanout, 0, int64_t>(vector<int64_t>{data}, move(positions), visit);
+  auto& tree = smtree.tree;
+  REQUIRE(visitedPayloads.size() == tree.size());
+  for (size_t level = 0; level < tree.size(); ++level) {
+    REQUIRE(visitedPayloads[level].size() == data.size());
+    for (size_t j = 0; j < data.size(); ++j) {
+      CHECK(tree[level].first[j] == data[visitedPayloads[level][j]]);
+    }
+  }
+}
+
+
+TEMPLATE_TEST_CASE_SIG("MergeSortTree::fromPermutation agrees with the constructor", "[mergesorttree]",
+                       ((unsigned fanout, unsigned cascading), fanout, cascading),
+                       (2, 0), (3, 0), (4, 0),
+                       (2, 1), (3, 1), (4, 1),
+                       (2, 2), (3, 3), (4, 4), (4, 2)) {
+  auto n = GENERATE(0, 1, 2, 7, 16, 100, 1000);
+  CAPTURE(n);
+  vector<int32_t> permutation(n);
+  for (int i = 0; i < n; ++i) permutation[i] = i;
+  mt19937 gen(n);
+  shuffle(permutation.begin(), permutation.end(), gen);
+
+  auto expected = MergeSortTree<fanout, cascading, int32_t, int32_t>(vector<int32_t>{permutation});
+  auto actual = MergeSortTree<fanout, cascading, int32_t, int32_t>::fromPermutation(vector<int32_t>{permutation});
+  REQUIRE(actual.tree.size() == expected.tree.size());
+  int64_t levelWidth = 1;
+  for (size_t level = 0; level < expected.tree.size(); ++level) {
+    CAPTURE(level);
+    CHECK(actual.tree[level].first == expected.tree[level].first);
+    REQUIRE(!actual.tree[level].second == !expected.tree[level].second);
+    if (expected.tree[level].second) {
+      int64_t runCnt = (n + levelWidth - 1) / levelWidth;
+      for (int64_t i = 0; i < runCnt * (2 + levelWidth / cascading) * fanout; ++i) {
+        CAPTURE(i);
+        REQUIRE(actual.tree[level].second[i] == expected.tree[level].second[i]);
+      }
+    }
+    levelWidth *= fanout;
+  }
+}
+
+
+TEMPLATE_TEST_CASE_SIG("MergeSortTree gallops through presorted inputs", "[mergesorttree]",
+                       ((unsigned fanout, unsigned cascading), fanout, cascading),
+                       (2, 0), (3, 0), (2, 2), (3, 3), (4, 4), (16, 4), (64, 64)) {
+  constexpr int32_t n = 5000;
+  auto shape = GENERATE(0, 1, 2, 3);
+  CAPTURE(shape);
+  // Sorted, reversed, interleaved sorted blocks, and sorted blocks in random order
+  vector<int32_t> permutation(n);
+  for (int i = 0; i < n; ++i) permutation[i] = i;
+  mt19937 gen(shape);
+  if (shape == 1) reverse(permutation.begin(), permutation.end());
+  if (shape == 2) {
+    for (int i = 0; i < n; ++i) permutation[i] = (i % 2) ? n / 2 + i / 2 : i / 2;
+  }
+  if (shape == 3) {
+    vector<int32_t> blockOrder(n / 100);
+    for (size_t i = 0; i < blockOrder.size(); ++i) blockOrder[i] = i;
+    shuffle(blockOrder.begin(), blockOrder.end(), gen);
+    for (int i = 0; i < n; ++i) permutation[i] = blockOrder[i / 100] * 100 + i % 100;
+  }
+
+  SECTION("the tree agrees with fromPermutation") {
+    auto expected = MergeSortTree<fanout, cascading, int32_t, int32_t>::fromPermutation(vector<int32_t>{permutation});
+    auto actual = MergeSortTree<fanout, cascading, int32_t, int32_t>(vector<int32_t>{permutation});
+    REQUIRE(actual.tree.size() == expected.tree.size());
+    int64_t levelWidth = 1;
+    for (size_t level = 0; level < expected.tree.size(); ++level) {
+      CAPTURE(level);
+      CHECK(actual.tree[level].first == expected.tree[level].first);
+      REQUIRE(!actual.tree[level].second == !expected.tree[level].second);
+      if (expected.tree[level].second) {
+        int64_t runCnt = (n + levelWidth - 1) / levelWidth;
+        for (int64_t i = 0; i < runCnt * (2 + levelWidth / cascading) * fanout; ++i) {
+          CAPTURE(i);
+          REQUIRE(actual.tree[level].second[i] == expected.tree[level].second[i]);
+        }
+      }
+      levelWidth *= fanout;
+    }
+  }
+
+  SECTION("duplicates keep the order of their positions") {
+    vector<int64_t> data(n), positions(n);
+    for (int i = 0; i < n; ++i) {
+      data[i] = permutation[i] / 7;
+      positions[i] = i;
+    }
+    vector<vector<int64_t>> visitedPayloads;
+    auto visit = [&](int64_t level, int64_t, int64_t pos, int64_t elem, int64_t payload) {
+      if (level == static_cast<int64_t>(visitedPayloads.size())) visitedPayloads.emplace_back();
+      REQUIRE(pos == static_cast<int64_t>(visitedPayloads[level].size()));
+      REQUIRE(elem == data[payload]);
+      visitedPayloads[level].push_back(payload);
+    };
+    auto smtree = MergeSortTree<fanout, cascading, int64_t>(vector<int64_t>{data}, move(positions), visit);
+    REQUIRE(visitedPayloads.size() == smtree.tree.size());
+    int64_t levelWidth = 1;
+    for (size_t level = 0; level < smtree.tree.size(); ++level) {
+      CAPTURE(level);
+      vector<int64_t> expected(n);
+      for (int i = 0; i < n; ++i) expected[i] = i;
+      for (int64_t begin = 0; begin < n; begin += levelWidth) {
+        auto end = min<int64_t>(begin + levelWidth, n);
+        stable_sort(expected.begin() + begin, expected.begin() + end, [&](int64_t a, int64_t b) { return data[a] < data[b]; });
+      }
+      CHECK(visitedPayloads[level] == expected);
+      levelWidth *= fanout;
+    }
+  }
+}
@@ -0,0 +1,36 @@
+#include <cmath>
+#include <limits>
+#include "catch.hpp"
+#include "orderedkey.hpp"
+
+using namespace std;
+
+TEST_CASE("orderedkey", "[orderedkey]") {
+  constexpr auto inf = numeric_limits<double>::infinity();
+  constexpr auto denormal = numeric_limits<double>::denorm_min();
+
+  SECTION("keys preserve the order") {
+    vector<double> ascending{-inf, -1e300, -2.5, -1, -denormal, 0, denormal, 1e-300, 1, 2.5, 1e300, inf, NAN};
+    for (size_t i = 1; i < ascending.size(); ++i) {
+      CAPTURE(ascending[i-1], ascending[i]);
+      CHECK(orderedkey::encode(ascending[i-1]) < orderedkey::encode(ascending[i]));
+    }
+  }
+
+  SECTION("decoding restores the values") {
+    for (double x : {-inf, -2.5, -denormal, 0.0, 1e-300, 3.75, inf}) {
+      CAPTURE(x);
+      CHECK(orderedkey::decode<double>(orderedkey::encode(x)) == x);
+    }
+    CHECK(orderedkey::decode<float>(orderedkey::encode(-1.25f)) == -1.25f);
+    CHECK(isnan(orderedkey::decode<double>(orderedkey::encode(NAN))));
+    CHECK(isnan(orderedkey::decode<double>(orderedkey::emptyKey)));
+  }
+
+  SECTION("-0 and all NaNs are canonicalized") {
+    CHECK(orderedkey::encode(-0.0) == orderedkey::encode(0.0));
+    CHECK(orderedkey::encode(-NAN) == orderedkey::encode(NAN));
+    CHECK(orderedkey::encode(-0.0f) == orderedkey::encode(0.0));
+    CHECK(orderedkey::encode(1.5f) == orderedkey::encode(1.5));
+  }
+}
@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <limits>
+#include "catch.hpp"
+#include "packedlevel.hpp"
+#include "data.hpp"
+
+using namespace std;
+
+TEMPLATE_TEST_CASE("PackedLevel", "[packedlevel]", int32_t, int64_t) {
+  auto checkRoundtrip = [](const vector<TestType>& values) {
+    PackedLevel<TestType> level(values);
+    REQUIRE(level.size() == static_cast<int64_t>(values.size()));
+    for (size_t i = 0; i < values.size(); ++i) {
+      CAPTURE(i);
+      REQUIRE(level[i] == values[i]);
+    }
+    CHECK(level.unpack() == values);
+  };
+
+  SECTION("empty") {
+    checkRoundtrip({});
+  }
+
+  SECTION("constant blocks need no bits") {
+    vector<TestType> values(200, 42);
+    checkRoundtrip(values);
+    CHECK(PackedLevel<TestType>(values).memoryUsage() < 200);
+  }
+
+  SECTION("full value range") {
+    vector<TestType> values;
+    for (int i = 0; i < 100; ++i) {
+      values.push_back(numeric_limits<TestType>::min() + i);
+      values.push_back(numeric_limits<TestType>::max() - i);
+      values.push_back(-i);
+    }
+    checkRoundtrip(values);
+  }
+
+  SECTION("sorted runs compress well") {
+    auto random = data::uniformRandomInts(10000, 1000000, 7);
+    vector<TestType> values(random.begin(), random.end());
+    for (size_t i = 0; i < values.size(); i += 1000) {
+      sort(values.begin() + i, values.begin() + i + 1000);
+    }
+    checkRoundtrip(values);
+    PackedLevel<TestType> level(values);
+    CHECK(level.memoryUsage() * 3 < static_cast<int64_t>(values.size() * sizeof(TestType)) * 2);
+    // Search within each sorted run
+    for (int64_t needle : {0, 1, 5000, 999999, 1000001}) {
+      for (int64_t i = 0; i < 10000; i += 1000) {
+        CAPTURE(needle, i);
+        auto expected = lower_bound(values.begin() + i, values.begin() + i + 1000, needle) - values.begin();
+        CHECK(lowerBound(level, i, i + 1000, needle) == expected);
+      }
+    }
+  }
+}
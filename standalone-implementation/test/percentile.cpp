@@ -1,3 +1,4 @@
+#include <string>
 #include "catch.hpp"
 #include "percentile.hpp"
 #include "framebounds.hpp"
@@ -59,6 +60,14 @@ TEST_CASE("naivePercentile", "[percentile]") {
     CHECK(naivePercentile(input, lower, upper, 0.5) == expected);
   }
 
+  SECTION("selects the maximum for p = 1") {
+    vector<int64_t> input   {1, 2, 3, 5, 9, 3, 0, 7, 4, 6};
+    vector<int64_t> expected{1, 2, 3, 5, 9, 9, 9, 7, 7, 7};
+    auto lower = framebounds::nPreceding<2>;
+    auto upper = framebounds::untilCurrentRow;
+    CHECK(naivePercentile(input, lower, upper, 1.0) == expected);
+  }
+
   SECTION("selects the 1st quantile") {
     vector<int64_t> input   {1, 2, 3, 5, 9, 3, 0, 7, 4, 6};
     vector<int64_t> expected{1, 1, 1, 2, 2, 2, 1, 2, 2, 2};
@@ -71,7 +80,7 @@ TEST_CASE("naivePercentile", "[percentile]") {
 
 TEST_CASE("incrementalPercentile agrees with naivePercentile", "[percentile]") {
   const auto& data = GENERATE_REF(as<vector<int64_t>>{}, data::values10, data::values20);
-  auto p = GENERATE(0.25, 0.5, 0.75);
+  auto p = GENERATE(0.0, 0.25, 0.5, 0.75, 1.0);
   CAPTURE(data, p);
   auto checkIt = [&](auto bounds, auto lower, auto upper) {
     CAPTURE(bounds);
@@ -85,6 +94,31 @@ TEST_CASE("incrementalPercentile agrees with naivePercentile", "[percentile]") {
 }
 
 
+TEST_CASE("countedBTreePercentile agrees with naivePercentile", "[percentile]") {
+  const auto& data = GENERATE_REF(as<vector<int64_t>>{}, data::values10, data::values20);
+  auto p = GENERATE(0.0, 0.25, 0.5, 0.75, 1.0);
+  CAPTURE(data, p);
+  vector<string> strings;
+  for (auto v : data) strings.push_back("value" + to_string(v));
+  vector<double> doubles;
+  for (auto v : data) doubles.push_back((v - 2.5) / 3);
+  auto checkIt = [&](auto bounds, auto lower, auto upper) {
+    CAPTURE(bounds);
+    CHECK(countedBTreePercentile(data, lower, upper, p) == naivePercentile(data, lower, upper, p));
+    CHECK(countedBTreePercentile(strings, lower, upper, p) == naivePercentile(strings, lower, upper, p));
+  };
+  checkIt("u,c", framebounds::unboundedPreceding, framebounds::untilCurrentRow);
+  checkIt("c,u", framebounds::fromCurrentRow, framebounds::unboundedFollowing);
+  checkIt("p,c", framebounds::nPreceding<3>, framebounds::untilCurrentRow);
+  checkIt("c,f", framebounds::fromCurrentRow, framebounds::nFollowing<3>);
+  checkIt("c,o", framebounds::fromCurrentRow, framebounds::oscillating);
+  checkIt("o,u", framebounds::oscillating, framebounds::unboundedFollowing);
+  // Empty frames yield NaN for doubles, which never compares equal
+  CHECK(countedBTreePercentile(doubles, framebounds::nPreceding<3>, framebounds::untilCurrentRow, p) ==
+        naivePercentile(doubles, framebounds::nPreceding<3>, framebounds::untilCurrentRow, p));
+}
+
+
 TEMPLATE_TEST_CASE_SIG("mergesortPercentile", "[percentile]",
                        ((unsigned fanout, unsigned cascading), fanout, cascading),
                        (2, 0), (3, 0), (4, 0),
@@ -93,15 +127,43 @@ TEMPLATE_TEST_CASE_SIG("mergesortPercentile", "[percentile]",
   const auto& data = GENERATE_REF(as<vector<int64_t>>{}, data::values10, data::values20);
 
   SECTION("agrees with naivePercentile on all quantiles") {
-    auto p = GENERATE(0.25, 0.5, 0.75);
+    auto p = GENERATE(0.0, 0.25, 0.5, 0.75, 1.0);
     auto checkIt = [&](auto bounds, auto lower, auto upper) {
       CAPTURE(bounds);
       CHECK(mergesortPercentile<fanout,cascading>(data, lower, upper, p) == naivePercentile(data, lower, upper, p));
+      CHECK(mergesortPercentile<fanout,cascading,true>(data, lower, upper, p) == naivePercentile(data, lower, upper, p));
+      CHECK(mergesortPercentile<fanout,cascading,false,false>(data, lower, upper, p) == naivePercentile(data, lower, upper, p));
     };
     checkIt("u,c", framebounds::unboundedPreceding, framebounds::untilCurrentRow);
     checkIt("c,u", framebounds::fromCurrentRow, framebounds::unboundedFollowing);
+    checkIt("u,u", framebounds::unboundedPreceding, framebounds::unboundedFollowing);
+    checkIt("u,f", framebounds::unboundedPreceding, framebounds::nFollowing<3>);
+    checkIt("p,u", framebounds::nPreceding<3>, framebounds::unboundedFollowing);
     checkIt("p,c", framebounds::nPreceding<3>, framebounds::untilCurrentRow);
     checkIt("c,f", framebounds::fromCurrentRow, framebounds::nFollowing<3>);
     checkIt("c,o", framebounds::fromCurrentRow, framebounds::oscillating);
   }
+  SECTION("agrees with naivePercentile on strings") {
+    vector<string> strings;
+    for (auto v : data) strings.push_back("value" + to_string(v));
+    auto checkIt = [&](auto bounds, auto lower, auto upper) {
+      CAPTURE(bounds);
+      CHECK(mergesortPercentile<fanout,cascading>(strings, lower, upper, 0.5) == naivePercentile(strings, lower, upper, 0.5));
+      CHECK(mergesortPercentile<fanout,cascading,false,false>(strings, lower, upper, 0.5) == naivePercentile(strings, lower, upper, 0.5));
+      CHECK(incrementalPercentile(strings, lower, upper, 0.5) == naivePercentile(strings, lower, upper, 0.5));
+    };
+    checkIt("u,c", framebounds::unboundedPreceding, framebounds::untilCurrentRow);
+    checkIt("p,c", framebounds::nPreceding<3>, framebounds::untilCurrentRow);
+    checkIt("c,o", framebounds::fromCurrentRow, framebounds::oscillating);
+  }
+  SECTION("agrees with naivePercentile on doubles") {
+    vector<double> doubles;
+    for (auto v : data) doubles.push_back((v - 2.5) / 3);
+    auto checkIt = [&](auto bounds, auto lower, auto upper) {
+      CAPTURE(bounds);
+      CHECK(mergesortPercentile<fanout,cascading>(doubles, lower, upper, 0.5) == naivePercentile(doubles, lower, upper, 0.5));
+    };
+    checkIt("u,c", framebounds::unboundedPreceding, framebounds::untilCurrentRow);
+    checkIt("p,c", framebounds::nPreceding<3>, framebounds::untilCurrentRow);
+  }
 }
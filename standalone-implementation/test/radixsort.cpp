@@ -0,0 +1,107 @@
+#include <algorithm>
+#include "catch.hpp"
+#include "radixsort.hpp"
+#include "data.hpp"
+
+using namespace std;
+
+TEST_CASE("radix::sortPairs sorts stably", "[radixsort]") {
+  auto threadCount = GENERATE(1, 4);
+  parallel::ScopedThreadCount threads(threadCount);
+  CAPTURE(threadCount);
+  auto checkIt = [](vector<uint64_t> keys) {
+    vector<uint64_t> expectedKeys = keys;
+    vector<int64_t> positions(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) positions[i] = i;
+    vector<int64_t> expectedPositions = positions;
+    stable_sort(expectedPositions.begin(), expectedPositions.end(), [&](int64_t a, int64_t b) { return keys[a] < keys[b]; });
+    sort(expectedKeys.begin(), expectedKeys.end());
+    auto singleKeys = keys;
+    auto singlePositions = positions;
+    radix::sortPairs(keys, positions);
+    CHECK(keys == expectedKeys);
+    CHECK(positions == expectedPositions);
+    // Sorting on the calling thread gives the same order
+    radix::sortPairs(singleKeys, singlePositions, radix::singleChunk);
+    CHECK(singleKeys == expectedKeys);
+    CHECK(singlePositions == expectedPositions);
+  };
+
+  SECTION("empty input") {
+    checkIt({});
+  }
+  SECTION("constant keys") {
+    checkIt(vector<uint64_t>(1000, 42));
+  }
+  SECTION("small keys") {
+    auto values = data::uniformRandomInts(300000, 1000, 1);
+    checkIt(vector<uint64_t>(values.begin(), values.end()));
+  }
+  SECTION("keys using all bytes") {
+    auto values = data::uniformRandomInts(300000, 1000, 2);
+    vector<uint64_t> keys;
+    for (auto v : values) keys.push_back(static_cast<uint64_t>(v) * 0x9e3779b97f4a7c15ull);
+    checkIt(keys);
+  }
+}
+
+
+TEST_CASE("radix::argsort sorts signed integers", "[radixsort]") {
+  auto values = data::uniformRandomInts(200000, 1000000, 3);
+  for (size_t i = 0; i < values.size(); i += 3) values[i] = -values[i] * 1000000007;
+  vector<int64_t> expectedIndices(values.size());
+  for (size_t i = 0; i < values.size(); ++i) expectedIndices[i] = i;
+  stable_sort(expectedIndices.begin(), expectedIndices.end(), [&](int64_t a, int64_t b) { return values[a] < values[b]; });
+
+  vector<int64_t> sorted;
+  vector<uint32_t> indices;
+  radix::argsort(values, sorted, indices);
+  REQUIRE(sorted.size() == values.size());
+  CHECK(is_sorted(sorted.begin(), sorted.end()));
+  CHECK(equal(indices.begin(), indices.end(), expectedIndices.begin(), expectedIndices.end()));
+  for (size_t i = 0; i < values.size(); i += 1000) {
+    CHECK(sorted[i] == values[indices[i]]);
+  }
+}
+
+TEST_CASE("radix::countingSort sorts stably", "[radixsort]") {
+  auto threadCount = GENERATE(1, 4);
+  parallel::ScopedThreadCount threads(threadCount);
+  CAPTURE(threadCount);
+  // Rows of dates in days, with negative dates before 1970
+  auto checkIt = [](const vector<pair<int32_t, int64_t>>& rows) {
+    auto expected = rows;
+    stable_sort(expected.begin(), expected.end(), [](auto& a, auto& b) { return a.first < b.first; });
+    vector<pair<int32_t, int64_t>> sorted(rows.size());
+    REQUIRE(radix::countingSort(rows.data(), sorted.data(), rows.size(), [](auto& row) { return row.first; }));
+    CHECK(sorted == expected);
+  };
+  auto makeRows = [](int64_t n, int64_t nrDistinct, int32_t offset) {
+    auto values = data::uniformRandomInts(n, nrDistinct, nrDistinct);
+    vector<pair<int32_t, int64_t>> rows;
+    for (size_t i = 0; i < values.size(); ++i) rows.emplace_back(static_cast<int32_t>(values[i]) + offset, i);
+    return rows;
+  };
+
+  SECTION("empty input") {
+    checkIt({});
+  }
+  SECTION("constant keys") {
+    checkIt(makeRows(1000, 1, 8000));
+  }
+  SECTION("dates") {
+    checkIt(makeRows(300000, 2557, 8035));
+    checkIt(makeRows(300000, 2557, -1000));
+  }
+  SECTION("the largest range") {
+    auto rows = makeRows(300000, radix::maxCountingRange - 1, -5);
+    rows[7].first = -5;
+    rows[8].first = radix::maxCountingRange - 6;
+    checkIt(rows);
+  }
+  SECTION("larger ranges are rejected") {
+    vector<int64_t> keys = {0, radix::maxCountingRange}, output(2, -1);
+    CHECK_FALSE(radix::countingSort(keys.data(), output.data(), 2, [](int64_t k) { return k; }));
+    CHECK(output == vector<int64_t>(2, -1));
+  }
+}
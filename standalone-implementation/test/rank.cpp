@@ -1,3 +1,4 @@
+#include <string>
 #include "catch.hpp"
 #include "rank.hpp"
 #include "framebounds.hpp"
@@ -35,10 +36,35 @@ TEMPLATE_TEST_CASE_SIG("mergesortRank", "[rank]",
     auto checkIt = [&](auto bounds, auto lower, auto upper) {
       CAPTURE(bounds);
       CHECK(mergesortRank<fanout, cascading>(data, lower, upper) == naiveRank(data, lower, upper));
+      CHECK(mergesortRank<fanout, cascading, false>(data, lower, upper) == naiveRank(data, lower, upper));
     };
     checkIt("u,c", framebounds::unboundedPreceding, framebounds::untilCurrentRow);
     checkIt("c,u", framebounds::fromCurrentRow, framebounds::unboundedFollowing);
+    checkIt("u,u", framebounds::unboundedPreceding, framebounds::unboundedFollowing);
+    checkIt("u,f", framebounds::unboundedPreceding, framebounds::nFollowing<3>);
+    checkIt("p,u", framebounds::nPreceding<3>, framebounds::unboundedFollowing);
     checkIt("p,c", framebounds::nPreceding<3>, framebounds::untilCurrentRow);
     checkIt("c,f", framebounds::fromCurrentRow, framebounds::nFollowing<3>);
   }
+  SECTION("agrees with naiveRank on strings") {
+    vector<string> strings;
+    for (auto v : data) strings.push_back("value" + to_string(v));
+    auto checkIt = [&](auto bounds, auto lower, auto upper) {
+      CAPTURE(bounds);
+      CHECK(mergesortRank<fanout, cascading>(strings, lower, upper) == naiveRank(strings, lower, upper));
+      CHECK(mergesortRank<fanout, cascading, false>(strings, lower, upper) == naiveRank(strings, lower, upper));
+    };
+    checkIt("u,c", framebounds::unboundedPreceding, framebounds::untilCurrentRow);
+    checkIt("p,c", framebounds::nPreceding<3>, framebounds::untilCurrentRow);
+  }
+  SECTION("agrees with naiveRank on doubles") {
+    vector<double> doubles;
+    for (auto v : data) doubles.push_back((v - 2.5) / 3);
+    auto checkIt = [&](auto bounds, auto lower, auto upper) {
+      CAPTURE(bounds);
+      CHECK(mergesortRank<fanout, cascading>(doubles, lower, upper) == naiveRank(doubles, lower, upper));
+    };
+    checkIt("u,c", framebounds::unboundedPreceding, framebounds::untilCurrentRow);
+    checkIt("p,c", framebounds::nPreceding<3>, framebounds::untilCurrentRow);
+  }
 }
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <random>
+#include "catch.hpp"
+#include "simdpartition.hpp"
+#include "percentile.hpp"
+
+using namespace std;
+
+namespace {
+  /// Restores the best instruction set when leaving a test
+  struct IsaGuard {
+    ~IsaGuard() { simdpartition::setIsa(simdpartition::Isa::Avx512); }
+  };
+}
+
+TEMPLATE_TEST_CASE("simdpartition::partitionLess", "[simdpartition]", int32_t, int64_t) {
+  IsaGuard guard;
+  auto isa = GENERATE(simdpartition::Isa::Scalar, simdpartition::Isa::Avx2, simdpartition::Isa::Avx512);
+  simdpartition::setIsa(isa);
+  CHECK(simdpartition::isa() <= isa);
+  // Sizes around the number of elements the kernels hold back for the scalar loop
+  auto n = GENERATE(0, 1, 7, 8, 15, 16, 23, 24, 25, 47, 48, 49, 1000, 4097);
+  auto domain = GENERATE(2, 50, 1000000);
+  mt19937 gen(n * 7 + domain);
+  vector<TestType> data(n);
+  for (auto& v : data) v = static_cast<TestType>(gen() % domain) - domain / 2;
+  auto pivot = static_cast<TestType>(gen() % domain) - domain / 2;
+  CAPTURE(isa, n, domain, pivot);
+  auto expectedCnt = count_if(data.begin(), data.end(), [&](auto v) { return v < pivot; });
+
+  SECTION("values") {
+    auto partitioned = data;
+    auto cnt = simdpartition::partitionLess(partitioned.data(), n, pivot);
+    REQUIRE(cnt == expectedCnt);
+    CHECK(all_of(partitioned.begin(), partitioned.begin() + cnt, [&](auto v) { return v < pivot; }));
+    CHECK(none_of(partitioned.begin() + cnt, partitioned.end(), [&](auto v) { return v < pivot; }));
+    sort(data.begin(), data.end());
+    sort(partitioned.begin(), partitioned.end());
+    CHECK(partitioned == data);
+  }
+
+  SECTION("pointers") {
+    vector<const TestType*> pointers;
+    for (auto& v : data) pointers.push_back(&v);
+    auto cnt = simdpartition::partitionLess(pointers.data(), n, pivot);
+    REQUIRE(cnt == expectedCnt);
+    CHECK(all_of(pointers.begin(), pointers.begin() + cnt, [&](auto v) { return *v < pivot; }));
+    CHECK(none_of(pointers.begin() + cnt, pointers.end(), [&](auto v) { return *v < pivot; }));
+    sort(pointers.begin(), pointers.end());
+    CHECK(adjacent_find(pointers.begin(), pointers.end()) == pointers.end());
+  }
+}
+
+TEST_CASE("simdpartition::partitionLess with extreme pivots", "[simdpartition]") {
+  IsaGuard guard;
+  auto isa = GENERATE(simdpartition::Isa::Scalar, simdpartition::Isa::Avx2, simdpartition::Isa::Avx512);
+  simdpartition::setIsa(isa);
+  vector<int64_t> data{numeric_limits<int64_t>::min(), 0, numeric_limits<int64_t>::max(), -1, 1};
+  data.resize(100, 3);
+  CHECK(simdpartition::partitionLess(data.data(), 100, numeric_limits<int64_t>::min()) == 0);
+  CHECK(simdpartition::partitionLess(data.data(), 100, numeric_limits<int64_t>::max()) == 99);
+  CHECK(simdpartition::partitionLess(data.data(), 100, int64_t{0}) == 2);
+}
+
+TEST_CASE("partitionNth on adversarial inputs", "[simdpartition]") {
+  constexpr int64_t n = 20000;
+  // Sorted, reversed, organ pipe, all equal and median-of-3 killer sequences
+  vector<vector<int64_t>> inputs(5, vector<int64_t>(n));
+  for (int64_t i = 0; i < n; ++i) {
+    inputs[0][i] = i;
+    inputs[1][i] = n - i;
+    inputs[2][i] = min(i, n - i);
+    inputs[3][i] = 42;
+    inputs[4][i] = i % 2 ? i : n / 2 + i / 2;
+  }
+  for (auto& input : inputs) {
+    auto sorted = input;
+    sort(sorted.begin(), sorted.end());
+    for (int64_t k : {int64_t{0}, n / 3, n / 2, n - 1}) {
+      CAPTURE(input[0], input[1], k);
+      auto values = input;
+      partitionNth(values.begin(), values.end(), k);
+      REQUIRE(values[k] == sorted[k]);
+      CHECK(all_of(values.begin(), values.begin() + k, [&](auto v) { return v <= sorted[k]; }));
+      CHECK(all_of(values.begin() + k, values.end(), [&](auto v) { return v >= sorted[k]; }));
+
+      vector<const int64_t*> pointers;
+      for (auto& v : input) pointers.push_back(&v);
+      partitionNth(pointers.begin(), pointers.end(), k, PointeeLess<int64_t>{});
+      REQUIRE(*pointers[k] == sorted[k]);
+
+      // Doubles take the generic path
+      vector<double> doubles(input.begin(), input.end());
+      CHECK(selectNthValue(doubles.begin(), doubles.end(), k) == static_cast<double>(sorted[k]));
+    }
+  }
+}